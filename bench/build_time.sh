@@ -0,0 +1,61 @@
+#!/bin/sh
+#
+# Compares the time it takes to compile N translation units that include
+# picoarg.hpp with the time it takes to compile the module interface and N
+# translation units that import it. Every translation unit also includes a
+# standard header, like real code does. The module needs GCC 14 or Clang 17,
+# see picoarg.cppm.
+#
+# Usage: bench/build_time.sh [N] [CXX]
+
+set -e
+
+N=${1:-100}
+CXX=${2:-g++}
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+cd "$WORK"
+
+i=0
+while [ "$i" -lt "$N" ]; do
+        cat > "include_$i.cpp" <<END
+#include <string>
+#include "$ROOT/picoarg.hpp"
+
+std::string parse_$i(int& argc, char* argv[])
+{
+        OptionParser parser;
+        parser.add('v');
+        parser.add('f', true);
+        return parser.parse(argc, argv) ? parser.popValue('f') : std::string();
+}
+END
+        sed -e "s|#include \"$ROOT/picoarg.hpp\"|import picoarg;|" \
+                "include_$i.cpp" > "import_$i.cpp"
+        i=$((i + 1))
+done
+
+now() {
+        date +%s.%N
+}
+
+start=$(now)
+i=0
+while [ "$i" -lt "$N" ]; do
+        $CXX -std=c++20 -c "include_$i.cpp" -o "include_$i.o"
+        i=$((i + 1))
+done
+included=$(awk "BEGIN { print $(now) - $start }")
+
+start=$(now)
+$CXX -std=c++20 -fmodules-ts -x c++ -c "$ROOT/picoarg.cppm" -o picoarg.o
+i=0
+while [ "$i" -lt "$N" ]; do
+        $CXX -std=c++20 -fmodules-ts -c "import_$i.cpp" -o "import_$i.o"
+        i=$((i + 1))
+done
+imported=$(awk "BEGIN { print $(now) - $start }")
+
+echo "$N translation units including picoarg.hpp: ${included}s"
+echo "$N translation units importing picoarg:     ${imported}s"
@@ -0,0 +1,151 @@
+// libFuzzer target for OptionParser::parse and the query API.
+//
+// The input is split at NUL bytes into the tokens of a command line. Besides
+// crashes and sanitizer reports, libFuzzer reports inputs that take longer
+// than '-timeout' seconds or allocate more than '-rss_limit_mb' megabytes,
+// which is how slow paths in the parser and the queries show up. See
+// fuzz/run.sh for the flags.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#define PICOARG_IMPL
+#include "../picoarg.hpp"
+
+namespace {
+
+enum class Level { Low, High };
+
+const OptionParser::Choice<Level> levels[] = {
+        { "low", Level::Low },
+        { "high", Level::High }
+};
+
+constexpr OptionParser::Pattern number("[0-9]+");
+
+void addOptions(OptionParser& parser)
+{
+        parser.add('v');
+        parser.add('f', true);
+        parser.add('o', true);
+        parser.add('l', levels);
+        parser.add('n', number);
+        parser.add('s', true);
+        parser.add(std::string("verbose"));
+        parser.add(std::string("output"), true);
+        parser.add(std::string("outline"), true);
+        parser.addFamily('D', [](int, const std::string&) { return true; });
+        parser.addMember('D', "name", 0, true);
+        parser.addMember('D', "debug", 1, false);
+}
+
+// Parses the command line 'toArgv' wrote and checks that it yields the same
+// values
+void checkRoundTrip(const OptionParser& parser)
+{
+        OptionParser::Argv argv = parser.toArgv();
+        OptionParser copy;
+        addOptions(copy);
+
+        int argc = argv.argc();
+        if (!copy.parse(argc, argv.argv())) {
+                __builtin_trap();
+        }
+
+        for (char key : { 'v', 'f', 'o', 'l', 'n', 's' }) {
+                OptionParser::Values expected = parser.values(key);
+                OptionParser::Values actual = copy.values(key);
+
+                if (expected.size() != actual.size()) {
+                        __builtin_trap();
+                }
+
+                for (std::size_t i = 0; i < expected.size(); ++i) {
+                        if (expected[i] != actual[i]) {
+                                __builtin_trap();
+                        }
+                }
+        }
+}
+
+} // namespace
+
+extern "C" int LLVMFuzzerInitialize(int*, char***)
+{
+        // Error messages only slow the fuzzer down
+        std::cout.rdbuf(nullptr);
+        return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t* data,
+                std::size_t size)
+{
+        if (size == 0) {
+                return 0;
+        }
+
+        // The first byte selects the mode, the rest are the tokens
+        bool collect = data[0] & 1;
+        std::vector<std::string> tokens { "fuzz" };
+        const char* first = reinterpret_cast<const char*>(data + 1);
+        const char* last = reinterpret_cast<const char*>(data + size);
+
+        while (first < last) {
+                const char* end = std::find(first, last, '\0');
+                tokens.emplace_back(first, end);
+                first = end + 1;
+        }
+
+        std::vector<char*> argv;
+        for (std::string& token : tokens) {
+                argv.push_back(&token[0]);
+        }
+        argv.push_back(nullptr);
+
+        OptionParser parser;
+        addOptions(parser);
+        parser.collectErrors(collect);
+
+        int argc = static_cast<int>(tokens.size());
+        if (!parser.parse(argc, argv.data())) {
+                return 0;
+        }
+
+        checkRoundTrip(parser);
+
+        for (int i = 0; i <= argc; ++i) {
+                parser.valueAt('o', i);
+        }
+
+        parser.indexOf('f');
+        parser.has(std::string("verbose"));
+        parser.has(std::string("outline"));
+
+        Level level;
+        std::uint64_t bytes;
+        while (parser.popChoice('l', level)) {}
+        while (parser.popSize('s', bytes)) {}
+
+        // Draining every option must stay linear in the number of tokens
+        while (parser.has('f')) {
+                parser.popValue('f');
+        }
+
+        while (parser.has('o') || parser.has('v')) {
+                parser.popValue('o');
+                parser.popValue('v');
+        }
+
+        while (parser.has(std::string("output"))) {
+                parser.popValue(std::string("output"));
+        }
+
+        parser.popValue('x');
+        parser.popValue(std::string("missing"));
+
+        return 0;
+}
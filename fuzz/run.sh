@@ -0,0 +1,30 @@
+#!/bin/sh
+#
+# Builds the libFuzzer target and runs it. Inputs that crash, take longer
+# than TIMEOUT seconds or use more than RSS_LIMIT megabytes are written to
+# fuzz/artifacts/ and can be replayed by passing them to the binary, e.g. to
+# keep them as regression cases for the benchmarks.
+#
+# Usage: fuzz/run.sh [SECONDS] [TIMEOUT] [RSS_LIMIT]
+
+set -e
+
+SECONDS_TOTAL=${1:-60}
+TIMEOUT=${2:-1}
+RSS_LIMIT=${3:-512}
+CXX=${CXX:-clang++}
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+OUT="$ROOT/fuzz/out"
+
+mkdir -p "$OUT" "$OUT/corpus" "$ROOT/fuzz/artifacts"
+
+"$CXX" -std=c++17 -g -O1 -fsanitize=fuzzer,address,undefined \
+        "$ROOT/fuzz/fuzz_parse.cpp" -o "$OUT/fuzz_parse"
+
+"$OUT/fuzz_parse" \
+        -max_total_time="$SECONDS_TOTAL" \
+        -timeout="$TIMEOUT" \
+        -rss_limit_mb="$RSS_LIMIT" \
+        -max_len=65536 \
+        -artifact_prefix="$ROOT/fuzz/artifacts/" \
+        "$OUT/corpus"
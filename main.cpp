@@ -9,6 +9,7 @@ int main(int argc, char* argv[])
         parser.add('h');
         parser.add('v');
         parser.add('f', true);
+        parser.add('q', true);
 
         if (!parser.parse(argc, argv)) {
                 return -1;
@@ -18,6 +19,8 @@ int main(int argc, char* argv[])
                 std::cout << "Usage: a.out [OPTION]" << std::endl;
                 std::cout << "  -v        show version information" << std::endl;
                 std::cout << "  -f<file>  process <file>" << std::endl;
+                std::cout << "  -q<n>     use quality <n> for the following files"
+                        << std::endl;
                 return 0;
         }
 
@@ -26,8 +29,13 @@ int main(int argc, char* argv[])
         }
 
         while (parser.has('f')) {
+                std::string quality = parser.valueAt('q', parser.indexOf('f'));
                 std::string filename = parser.popValue('f');
-                std::cout << "processing '" << filename << "'" << std::endl;
+                std::cout << "processing '" << filename << "'";
+                if (!quality.empty()) {
+                        std::cout << " with quality " << quality;
+                }
+                std::cout << std::endl;
         }
 
         return 0;
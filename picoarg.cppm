@@ -0,0 +1,70 @@
+/*
+   picoarg.cppm
+
+   Summary:
+        The C++20 module interface of picoarg. It exports 'OptionParser' and
+        contains the implementation, so importers neither parse the header
+        nor define PICOARG_IMPL. The 'PICOARG_OPTION' macro isn't available
+        to importers.
+
+   Usage:
+        g++ -std=c++20 -fmodules-ts -x c++ -c picoarg.cppm
+        g++ -std=c++20 -fmodules-ts -c main.cpp   (with 'import picoarg;')
+
+        Importers may include standard headers before 'import picoarg;'.
+        This needs GCC 14 or Clang 17 or newer. Older GCC versions can only
+        build importers that include nothing: with a standard header they
+        crash or produce programs that crash, so they are rejected below.
+*/
+
+module;
+
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ < 14
+#error "picoarg.cppm needs GCC 14 or newer, use picoarg.hpp instead"
+#elif defined(__clang__) && __clang_major__ < 17
+#error "picoarg.cppm needs Clang 17 or newer, use picoarg.hpp instead"
+#endif
+
+// Everything picoarg.hpp includes belongs to the global module fragment, its
+// own includes are then skipped by the include guards
+#include <vector>
+#include <array>
+#include <string>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <charconv>
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string_view>
+
+#if defined(__unix__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#endif
+
+export module picoarg;
+
+#define PICOARG_EXPORT export
+#define PICOARG_IMPL
+#include "picoarg.hpp"
@@ -1,12 +1,12 @@
 /*
-   picoarg.hpp - 1.2.0
+   picoarg.hpp - 1.25.0
 
    Author:
         Paul Meffle
 
    Summary:
         picoarg is a single-file header that implements a simple commandline
-        option parser.
+        option parser. It requires C++17 since version 1.3.0.
 
    Revision history:
         1.0   (15.08.2017) initial release
@@ -15,20 +15,358 @@
         1.1.0 (13.09.2017) remove parsing of inline values
         1.1.1 (13.09.2017) apply new naming convention
         1.2.0 (14.09.2017) only allow inline values
+        1.3.0 (17.10.2026) add size, duration and rate accessors
+        1.4.0 (17.10.2026) add enumerated options
+        1.5.0 (17.10.2026) optionally collect all errors
+        1.6.0 (17.10.2026) add long options with typo suggestions
+        1.7.0 (17.10.2026) allow unique abbreviations of long options
+        1.8.0 (17.10.2026) add option families
+        1.9.0 (17.10.2026) add link-time option registry
+        1.10.0 (17.10.2026) add live options, keep options after parsing
+        1.11.0 (17.10.2026) add config files that reload when changed
+        1.12.0 (17.10.2026) write parsed options back to an argv
+        1.13.0 (17.10.2026) add incremental parsing
+        1.14.0 (17.10.2026) add completion index files
+        1.15.0 (17.10.2026) record positions, add scoped option values
+        1.16.0 (17.10.2026) validate input groups in parallel
+        1.17.0 (17.10.2026) index parsed options by key
+        1.18.0 (17.10.2026) add response files and parse limits
+        1.19.0 (17.10.2026) add value patterns compiled at compile time
+        1.20.0 (17.10.2026) classify tokens in batches (removed again)
+        1.21.0 (17.10.2026) parse the command line of the process lazily
+        1.22.0 (17.10.2026) freeze the schema before parsing
+        1.23.0 (17.10.2026) allow unicode code points as option keys
+        1.24.0 (17.10.2026) cache validated parse results on disk
+        1.25.0 (17.10.2026) add a fingerprint of the parse result
 */
 
 #ifndef _PICOARG_HPP
 #define _PICOARG_HPP
 
 #include <vector>
+#include <array>
+#include <string>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <cstdint>
+#include <functional>
+
+// Set to 'export' by the module interface in picoarg.cppm
+#ifndef PICOARG_EXPORT
+#define PICOARG_EXPORT
+#endif
+
+PICOARG_EXPORT class OptionParser {
+        struct Option;
 
-class OptionParser {
 public:
+        OptionParser() = default;
+
+        /**
+         * A named value of an enumerated option.
+         */
+        template <typename E>
+        struct Choice {
+                const char* name;
+                E value;
+        };
+
+        /**
+         * The kinds of errors 'parse' can encounter.
+         */
+        enum class Error {
+                ExpectedOption,
+                UnrecognizedOption,
+                AmbiguousOption,
+                MissingValue,
+                UnexpectedValue,
+                InvalidChoice,
+                InvalidValue,
+                RejectedMember,
+                InvalidInput,
+                UnreadableFile,
+                TooManyTokens,
+                TooManyValueBytes,
+                TooManyOccurrences,
+                TooDeeplyNested,
+                DuplicateOption,
+                TooManyKeys
+        };
+
+        /**
+         * Bounds the work 'parse' does for a single command line: the number
+         * of tokens including those in response files, the total size of all
+         * values in bytes, the number of times a single option or family
+         * member may be given and how deep response files may include each
+         * other. Exceeding a limit stops 'parse' right away, even when
+         * collecting errors. Response files are only read if
+         * 'responseFiles' is set, they are checked against the limits while
+         * they are read.
+         */
+        struct Limits {
+                std::size_t maxTokens = SIZE_MAX;
+                std::size_t maxValueBytes = SIZE_MAX;
+                std::size_t maxOccurrences = SIZE_MAX;
+                std::size_t maxDepth = 8;
+                bool responseFiles = false;
+        };
+
+        /**
+         * Handles a member of an option family while parsing. 'member' is the
+         * id it was added with, 'value' is the text after '=' or an empty
+         * string.
+         *
+         * @return True if the member is accepted
+         */
+        using FamilyHandler = std::function<bool(int member,
+                        const std::string& value)>;
+
+        /**
+         * An option declared with 'PICOARG_OPTION'. 'key' is '\0' for long
+         * only options, 'name' is nullptr for short only options.
+         */
+        struct Descriptor {
+                char key;
+                const char* name;
+                bool expectsValue;
+        };
+
+        /**
+         * An error found by 'parse'. 'index' is the position of the token in
+         * 'argv', 'key' is the name of the option or '\0' if the token isn't
+         * an option or a long option.
+         */
+        struct Diagnostic {
+                Error kind;
+                int index;
+                char key;
+        };
+
+        /**
+         * An immutable set of option values that can be read while another
+         * thread publishes a newer one.
+         */
+        class Snapshot {
+        public:
+                /**
+                 * Checks whether an option is set.
+                 *
+                 * @param key The name of the option
+                 *
+                 * @return True if the option is set
+                 */
+                bool has(const char& key) const;
+
+                /**
+                 * Returns the last value of an option or an empty string if
+                 * the option isn't set.
+                 *
+                 * @param key The name of the option
+                 *
+                 * @return The value
+                 */
+                const std::string& value(const char& key) const;
+
+        private:
+                friend class OptionParser;
+
+                std::vector<Option> options;
+        };
+
+        /**
+         * Keeps the snapshot returned by 'live' or 'config' from being freed
+         * until it is destroyed. Snapshots published in the meantime aren't
+         * freed either, so don't keep it around, and it must not outlive the
+         * parser.
+         */
+        class SnapshotRef {
+        public:
+                SnapshotRef(SnapshotRef&& other) noexcept;
+                SnapshotRef& operator=(SnapshotRef&& other) noexcept;
+                ~SnapshotRef();
+
+                const Snapshot& operator*() const;
+                const Snapshot* operator->() const;
+
+        private:
+                friend class OptionParser;
+
+                SnapshotRef(const Snapshot* snapshot,
+                                std::atomic<std::uint64_t>* reader);
+
+                const Snapshot* snapshot;
+                std::atomic<std::uint64_t>* reader;
+        };
+
+        /**
+         * A command line written by 'toArgv'. All strings are stored in one
+         * buffer, 'argv' is terminated by a nullptr so it can be passed to
+         * 'execv'.
+         */
+        class Argv {
+        public:
+                int argc() const;
+                char** argv() const;
+
+        private:
+                friend class OptionParser;
+
+                std::unique_ptr<char[]> strings;
+                std::unique_ptr<char*[]> pointers;
+                int count = 0;
+        };
+
+        /**
+         * Replaces every value of an option when calling 'toArgv'. The
+         * option is given by its key, its code point key or its long name.
+         * An empty list of values removes the option, options without a
+         * value take an empty string per occurrence.
+         */
+        struct Override {
+                Override(const char& key, std::vector<std::string> values);
+                Override(char32_t key, std::vector<std::string> values);
+                Override(std::string name, std::vector<std::string> values);
+
+                char key = '\0';
+                char32_t codePoint = 0;
+                std::string name;
+                std::vector<std::string> values;
+        };
+
+        class Incremental;
+
+        /**
+         * A pattern for option values that is compiled into a DFA at compile
+         * time. A pattern is a sequence of atoms, each optionally followed by
+         * '?', '*' or '+'. An atom is a character, '.' for any character, a
+         * class like '[a-z_]' or '[^:]' or one of the escapes '\d' (digit),
+         * '\w' (word character) and '\x' (hex digit). There is no
+         * alternation or grouping, the whole value has to match.
+         *
+         * Example: static constexpr OptionParser::Pattern hostPort(
+         *                 "[a-z0-9.-]+:\\d+");
+         */
+        class Pattern {
+        public:
+                static constexpr std::size_t maxAtoms = 31;
+                static constexpr std::size_t maxStates = 32;
+
+                constexpr explicit Pattern(const char* pattern);
+
+                /**
+                 * Checks whether the text in [first, last) matches.
+                 */
+                bool matches(const char* first, const char* last) const;
+
+        private:
+                friend class OptionParser;
+
+                using Set = std::uint64_t[4];
+
+                static constexpr void insert(Set& set, unsigned char first,
+                                unsigned char last);
+                static constexpr bool contains(const Set& set, unsigned char c);
+                static constexpr const char* parseClass(const char* it, Set& set);
+
+                /**
+                 * State 0 rejects, state 1 is the start state.
+                 */
+                std::uint8_t next[maxStates][256] {};
+                bool accepting[maxStates] {};
+        };
+
+        /**
+         * An input, i.e. one occurrence of an option like '-f', together with
+         * the options in effect at its position. See 'validate'.
+         */
+        class Group {
+        public:
+                /**
+                 * Returns the number of the group, counting from 0 in the
+                 * order of 'argv'. Useful to store converted values.
+                 */
+                std::size_t number() const;
+
+                /**
+                 * Returns the position of the input in 'argv'.
+                 */
+                int index() const;
+
+                /**
+                 * Returns the value of the input option.
+                 */
+                const std::string& input() const;
+
+                /**
+                 * Returns the value of an option in effect for the input, like
+                 * 'valueAt'. Only the keys passed to 'validate' are available.
+                 */
+                const std::string& value(const char& key) const;
+
+        private:
+                friend class OptionParser;
+
+                const OptionParser* parser;
+                std::size_t ordinal;
+                const Option* option;
+        };
+
+        /**
+         * The values of all occurrences of an option in the order of 'argv',
+         * returned by 'values'.
+         */
+        class Values {
+        public:
+                class Iterator {
+                public:
+                        const std::string& operator*() const;
+                        Iterator& operator++();
+                        bool operator!=(const Iterator& other) const;
+
+                private:
+                        friend class Values;
+
+                        const Values* values;
+                        std::size_t i;
+                };
+
+                std::size_t size() const;
+                const std::string& operator[](std::size_t i) const;
+                Iterator begin() const;
+                Iterator end() const;
+
+        private:
+                friend class OptionParser;
+
+                const std::vector<Option>* parsed;
+                const std::uint32_t* first;
+                const std::uint32_t* last;
+        };
+
+        /**
+         * Validates a group and converts its values, writing a message to
+         * 'error' if the group is invalid. Runs concurrently for different
+         * groups.
+         */
+        using Validator = std::function<bool(const Group& group,
+                        std::string& error)>;
+
+        /**
+         * The number of diagnostics that are kept when collecting errors.
+         */
+        static constexpr std::size_t maxDiagnostics = 32;
+
         /**
          * Parses the options passed to the program. Each option in 'argv' gets
          * compared with the user added options. If it is found and has an
-         * value, the value gets parsed aswell.
+         * value, the value gets parsed aswell. If response files are enabled
+         * in the limits, a token '@file' is replaced by the whitespace
+         * separated tokens in 'file', positions count the tokens after this
+         * replacement.
          *
          * @param argc The option count
          * @param argv The actual options
@@ -37,6 +375,62 @@ public:
          */
         bool parse(int& argc, char* argv[]);
 
+        /**
+         * Checks the added options and builds the lookup structures used by
+         * 'parse'. Two options with the same key or name, two members of a
+         * family with the same name or a family prefix that is also an
+         * option key are rejected. 'parse' freezes the schema itself if an
+         * option was added since the last call.
+         *
+         * @return True if the schema is valid
+         */
+        bool freeze();
+
+        /**
+         * Sets the limits that 'parse' enforces.
+         *
+         * @param limits The limits
+         */
+        void setLimits(const Limits& limits);
+
+        /**
+         * Returns a parser for the command line of the current process,
+         * for code that has no access to 'argv'. The first call reads
+         * '/proc/self/cmdline' and parses it with the options declared by
+         * 'PICOARG_OPTION', later calls return the same parser. Tokens that
+         * aren't valid options, like the ones of other libraries, are
+         * skipped and nothing gets printed. Safe to call from any thread,
+         * use 'values' to query the options.
+         *
+         * @return The parser
+         */
+        static const OptionParser& process();
+
+        /**
+         * Makes 'parse' continue after an error instead of returning at the
+         * first one. Every error gets recorded as a diagnostic, the first
+         * 'maxDiagnostics' of them are kept.
+         *
+         * @param collect Indicates whether all errors should be collected
+         */
+        void collectErrors(bool collect);
+
+        /**
+         * Returns the diagnostics recorded by the last call to 'parse'.
+         */
+        const Diagnostic* diagnostics() const;
+
+        /**
+         * Returns the number of diagnostics returned by 'diagnostics'.
+         */
+        std::size_t diagnosticCount() const;
+
+        /**
+         * Returns the number of errors found by the last call to 'parse',
+         * including the ones that didn't fit into the diagnostic buffer.
+         */
+        std::size_t errorCount() const;
+
         /**
          * Adds an option to the internal 'options' list that is used by the
          * 'parse' function.
@@ -44,7 +438,127 @@ public:
          * @param key The name of the option
          * @param expectsValue Indicates whether the option takes a value
          */
-        void add(const char& key, bool expectsValue);
+        void add(const char& key, bool expectsValue = false);
+
+        /**
+         * Adds an option whose key is a unicode code point, e.g. U'λ' for
+         * '-λ'. The key is matched against the first UTF-8 sequence after
+         * the '-'. At most 128 keys outside of ASCII are supported.
+         *
+         * @param key The name of the option
+         * @param expectsValue Indicates whether the option takes a value
+         */
+        void add(char32_t key, bool expectsValue = false);
+
+        /**
+         * Adds a long option that is passed as '--name' or, if it takes a
+         * value, as '--name=value'. Any unique prefix of the name is accepted
+         * as well.
+         *
+         * @param name The name of the option
+         * @param expectsValue Indicates whether the option takes a value
+         */
+        void add(const std::string& name, bool expectsValue = false);
+
+        /**
+         * Adds an option whose value has to be one of the names in
+         * 'choices'. The value gets validated and converted by 'parse', use
+         * 'popChoice' to retrieve it.
+         *
+         * @param key The name of the option
+         * @param choices The allowed values
+         */
+        template <typename E, std::size_t N>
+        void add(const char& key, const Choice<E> (&choices)[N]);
+
+        /**
+         * Adds an option whose value has to match 'pattern'. The value gets
+         * checked by 'parse'. The pattern isn't copied, so it has to outlive
+         * the parser.
+         *
+         * @param key The name of the option
+         * @param pattern The pattern of the value
+         */
+        void add(const char& key, const Pattern& pattern);
+
+        /**
+         * Adds an option that can be changed while the program is running.
+         * Its latest value is published as part of the snapshot returned by
+         * 'live' after 'parse' and every 'update'.
+         *
+         * @param key The name of the option
+         * @param expectsValue Indicates whether the option takes a value
+         */
+        void addLive(const char& key, bool expectsValue = false);
+
+        /**
+         * Parses a command like '-l3 -r100' and publishes a new snapshot with
+         * the live options it contains. Other options are rejected. Can be
+         * called from any thread while others read 'live', after 'parse'.
+         * The errors of 'parse' are kept.
+         *
+         * @param command The whitespace separated options
+         *
+         * @return True if successful
+         */
+        bool update(const std::string& command);
+
+        /**
+         * Returns the latest snapshot of the live options. Reading takes no
+         * lock: the reader marks a slot of its own as in use and loads the
+         * snapshot pointer, writers free old snapshots once no slot marked
+         * before they were replaced is in use.
+         */
+        SnapshotRef live() const;
+
+        /**
+         * Loads options from a file and reloads it whenever it changes. The
+         * file contains whitespace separated options, '#' starts a comment
+         * that runs to the end of the line. Each successful load is
+         * published as a new snapshot returned by 'config', a file that
+         * fails to parse leaves the previous snapshot in place. Call this
+         * once, after 'parse'. Reloads don't change the errors of 'parse'.
+         *
+         * @param path The path of the file
+         *
+         * @return True if the file was loaded and is being watched
+         */
+        bool watch(const std::string& path);
+
+        /**
+         * Returns the latest snapshot of the options in the watched file,
+         * read the same way as 'live'.
+         */
+        SnapshotRef config() const;
+
+        /**
+         * Adds an option family. Every token starting with '-' and 'prefix'
+         * names a member of the family, e.g. '-Wall' or '-Wformat=2' for
+         * the prefix 'W'. Members are passed to 'handler' by 'parse' and
+         * don't show up in the parsed options.
+         *
+         * @param prefix The key that starts the members
+         * @param handler The function that handles the members
+         */
+        void addFamily(const char& prefix, FamilyHandler handler);
+
+        /**
+         * Adds a member to an option family.
+         *
+         * @param prefix The key of the family
+         * @param name The name of the member without the prefix
+         * @param member The id that is passed to the handler
+         * @param expectsValue Indicates whether the member takes a value
+         */
+        void addMember(const char& prefix, const std::string& name, int member,
+                        bool expectsValue = false);
+
+        /**
+         * Adds the options declared with 'PICOARG_OPTION' in any translation
+         * unit of the program. Parsers only know these options after calling
+         * this, calling it again does nothing.
+         */
+        void addRegistered();
 
         /**
          * Checks whether an option exists.
@@ -54,6 +568,16 @@ public:
          * @return True if the option exists
          */
         bool has(const char& key);
+        bool has(char32_t key);
+
+        /**
+         * Checks whether a long option exists.
+         *
+         * @param name The name of the option
+         *
+         * @return True if the option exists
+         */
+        bool has(const std::string& name);
 
         /**
          * Returns the value of an option. If an option doesn't exist or it
@@ -65,131 +589,4206 @@ public:
          * @return The value
          */
         std::string popValue(const char& key);
+        std::string popValue(char32_t key);
 
-private:
         /**
-         * The internal representation of an option. If an option doesn't take
-         * a value, 'value' contains an empty string.
+         * Returns the value of a long option, see 'popValue' above.
+         *
+         * @param name The name of the option
+         *
+         * @return The value
          */
-        struct Option {
-                char key;
-                std::string value;
-                bool expectsValue;
-        };
+        std::string popValue(const std::string& name);
 
         /**
-         * A helper struct to find an option by its key.
+         * Returns the values of every occurrence of an option, including the
+         * ones that were popped. The values are a contiguous slice of an
+         * index built by 'parse', so this doesn't search.
+         *
+         * @param key The name of the option
+         *
+         * @return The values in the order of 'argv'
          */
-        struct Compare {
-                Compare(const char& key)
-                        : key(key)
-                {
-                }
+        Values values(const char& key) const;
+        Values values(char32_t key) const;
 
-                bool operator()(const Option& option)
-                {
-                        return option.key == key;
-                }
+        /**
+         * Returns the position in 'argv' of the value 'popValue' would return
+         * next.
+         *
+         * @param key The name of the option
+         *
+         * @return The position or 0 if the option doesn't exist
+         */
+        int indexOf(const char& key);
 
-                char key;
-        };
+        /**
+         * Returns the value of the last occurrence of an option at or before
+         * a position in 'argv', e.g. the setting in effect for the input at
+         * that position. Popping options doesn't change the result. The
+         * first query for a key builds a table of all positions, later ones
+         * are a single lookup.
+         *
+         * @param key The name of the option
+         * @param index The position in 'argv'
+         *
+         * @return The value or an empty string if there is no occurrence
+         */
+        const std::string& valueAt(const char& key, int index);
 
         /**
-         * Checks whether 'token' is two characters long and starts with a '-'
-         * character.
+         * Runs 'validator' for every occurrence of 'inputKey' on 'threads'
+         * threads. Errors are reported in the order of 'argv' after all
+         * groups are done, as 'InvalidInput' diagnostics with the position
+         * of the input, so the result doesn't depend on the number of
+         * threads.
          *
-         * @param The token to check
+         * @param inputKey The name of the option whose occurrences are inputs
+         * @param keys The options the validator reads through 'Group::value'
+         * @param validator The function that validates a group
+         * @param threads The number of threads or 0 to use one per core
          *
-         * @return True if the token is two characters long and starts with '-'
+         * @return True if every group is valid
          */
-        bool isOption(const std::string& token);
+        bool validate(const char& inputKey, const std::vector<char>& keys,
+                        const Validator& validator, unsigned threads = 0);
 
-        std::vector<Option> options;
-        std::vector<Option> parsed;
-};
+        /**
+         * Makes 'parse' look up its result in a cache file before parsing.
+         * The result is found if the program, the working directory, the
+         * arguments and the options added to the parser are the same as
+         * when it was stored and none of its inputs changed. The inputs are
+         * the response files and the values of 'inputKey', which are
+         * compared by modification time and size. The file holds a single
+         * result, each call to 'storeCache' replaces the one before, so use
+         * one file per command line that should stay cached. Parsers with
+         * option families never use the cache, since a cached result
+         * wouldn't call their handlers. Only available on unix.
+         *
+         * @param path The cache file
+         * @param inputKey The option whose values are input files or '\0'
+         */
+        void useCache(const std::string& path, const char& inputKey = '\0');
 
-#endif // _PICOARG_HPP
+        /**
+         * Checks whether the last call to 'parse' took its result from the
+         * cache, in which case it was validated before and 'validate' can
+         * be skipped.
+         *
+         * @return True if the result came from the cache
+         */
+        bool cached() const;
 
-#ifdef PICOARG_IMPL
+        /**
+         * Writes the result of the last call to 'parse' to the cache file
+         * set by 'useCache'. Call it once the result is validated, since
+         * later runs with the same arguments trust it.
+         *
+         * @return True if the result was written or came from the cache
+         */
+        bool storeCache();
 
-bool OptionParser::parse(int& argc, char* argv[])
-{
-        std::vector<std::string> args(argv + 1, argv + argc);
+        /**
+         * Writes the parsed options that haven't been popped back to a
+         * command line that 'parse' turns into the same options. Options
+         * that are overridden are left out and their new values are appended
+         * in the order of 'overrides'. Family members aren't included.
+         * Overrides are checked like 'parse' checks options, an unknown
+         * option or a value it wouldn't accept is printed and gives an
+         * empty command line.
+         *
+         * @param overrides The options to replace
+         *
+         * @return The command line, starting with the program name, or an
+         *         empty one without 'argv' if an override is invalid
+         */
+        Argv toArgv(const std::vector<Override>& overrides = {}) const;
 
-        for(auto it = args.begin(); it < args.end(); ++it) {
-                std::string token = *it;
+        /**
+         * Returns a 64 bit hash of the parsed options, including the ones
+         * that were popped. Only the order of options with the same key or
+         * name matters, so command lines that differ in the order of
+         * different options get the same fingerprint.
+         *
+         * @return The fingerprint
+         */
+        std::uint64_t fingerprint() const;
 
-                if (!isOption(token)) {
-                        std::cout << argv[0] << ": expected an option, found '"
-                                << token << "'" << std::endl;
-                        return false;
-                }
+        /**
+         * Writes every token that names an option to a file, sorted so
+         * 'complete' can search it. Options that take a value end with '='
+         * if they are long options or family members, enumerated options
+         * are listed with each of their values.
+         *
+         * @param path The path of the file
+         *
+         * @return True if the file was written
+         */
+        bool writeCompletions(const std::string& path);
 
-                char key = token[1];
+        /**
+         * Returns the tokens in a file written by 'writeCompletions' that
+         * start with 'partial'. This maps the file and does a binary search,
+         * no parser is needed.
+         *
+         * @param path The path of the file
+         * @param partial The token to complete
+         *
+         * @return The candidates in sorted order
+         */
+        static std::vector<std::string> complete(const std::string& path,
+                        const std::string& partial);
 
-                auto optionIt = std::find_if(options.begin(), options.end(),
-                                Compare(key));
+        /**
+         * Pops the value of an option and parses it as a byte size. The
+         * number may be followed by a binary ('K', 'KiB', 'M', 'MiB', ...)
+         * or a decimal ('kB', 'MB', ...) unit.
+         *
+         * @param key The name of the option
+         * @param bytes Receives the size in bytes
+         *
+         * @return True if the option exists and its value is a valid size
+         */
+        bool popSize(const char& key, std::uint64_t& bytes);
+
+        /**
+         * Pops the value of an option and parses it as a duration. The
+         * number may be followed by 'ns', 'us', 'ms', 's', 'm' or 'h', a bare
+         * number is taken as seconds.
+         *
+         * @param key The name of the option
+         * @param duration Receives the duration
+         *
+         * @return True if the option exists and its value is a valid duration
+         */
+        bool popDuration(const char& key, std::chrono::nanoseconds& duration);
+
+        /**
+         * Pops the value of an option and parses it as a rate like '10k/s' or
+         * '500/100ms'. The count may be followed by 'k', 'M' or 'G', the
+         * period is a duration and defaults to one second.
+         *
+         * @param key The name of the option
+         * @param count Receives the number of events
+         * @param period Receives the period the events are counted over
+         *
+         * @return True if the option exists and its value is a valid rate
+         */
+        bool popRate(const char& key, std::uint64_t& count,
+                        std::chrono::nanoseconds& period);
+
+        /**
+         * Pops the converted value of an enumerated option.
+         *
+         * @param key The name of the option
+         * @param value Receives the value
+         *
+         * @return True if the option exists and is enumerated
+         */
+        template <typename E>
+        bool popChoice(const char& key, E& value);
+
+private:
+        /**
+         * The internal representation of an option. If an option doesn't take
+         * a value, 'value' contains an empty string. 'choices' is the index
+         * of the allowed values of an enumerated option or -1. Long options
+         * have a 'name' and '\0' as their 'key'. 'live' options are
+         * published in snapshots. 'index' is the position in 'argv' and
+         * 'popped' is set once the option was returned by a 'pop' function.
+         * 'pattern' is the pattern the value has to match or nullptr.
+         */
+        struct Option {
+                char key;
+                std::string value;
+                bool expectsValue;
+                int choices = -1;
+                int choice = 0;
+                std::string name = "";
+                bool live = false;
+                bool popped = false;
+                int index = 0;
+                char32_t codePoint = 0;
+                const Pattern* pattern = nullptr;
+        };
+
+        /**
+         * The allowed values of an enumerated option. 'slots' is a
+         * collision free hash table that maps a name to its index.
+         */
+        struct ChoiceSet {
+                std::vector<std::string> names;
+                std::vector<int> values;
+                std::vector<int> slots;
+                std::uint32_t seed;
+        };
+
+        /**
+         * A helper struct to find an option by its key.
+         */
+        struct Compare {
+                Compare(const char& key)
+                        : key(key)
+                {
+                }
+
+                bool operator()(const Option& option)
+                {
+                        return option.key == key;
+                }
+
+                char key;
+        };
+
+        /**
+         * A helper struct to find a long option by its name.
+         */
+        struct CompareName {
+                CompareName(const std::string& name)
+                        : name(name)
+                {
+                }
+
+                bool operator()(const Option& option)
+                {
+                        return !option.name.empty() && option.name == name;
+                }
+
+                const std::string& name;
+        };
+
+        /**
+         * A packed trie over option names. The edges of a node are stored
+         * next to each other, so a lookup touches one node and a short run of
+         * edges per character.
+         */
+        struct NameIndex {
+                /**
+                 * 'value' belongs to the name ending at this node or is -1,
+                 * 'unique' is the value of the only name below this node or
+                 * -2 if there are several.
+                 */
+                struct Node {
+                        std::uint32_t firstEdge;
+                        std::uint32_t edgeCount;
+                        int value;
+                        int unique;
+                };
+
+                struct Edge {
+                        char label;
+                        std::uint32_t child;
+                };
+
+                /**
+                 * Builds the trie. If a name appears more than once, the
+                 * first value is kept.
+                 *
+                 * @param names The names and their values
+                 */
+                void build(std::vector<std::pair<std::string, int>> names);
+
+                /**
+                 * Looks up a name or, if 'allowPrefix' is set and there is no
+                 * exact match, the only name starting with it.
+                 *
+                 * @return The value, -1 if nothing matches or -2 if the
+                 *         prefix is ambiguous
+                 */
+                int find(const char* name, std::size_t size,
+                                bool allowPrefix) const;
+
+                std::vector<Node> nodes;
+                std::vector<Edge> edges;
+
+        private:
+                std::uint32_t build(
+                                const std::vector<std::pair<std::string, int>>& names,
+                                std::size_t first, std::size_t last,
+                                std::size_t depth);
+        };
+
+        /**
+         * A family of options sharing a prefix. 'index' maps the name of a
+         * member to its position in 'members'.
+         */
+        struct Family {
+                struct Member {
+                        std::string name;
+                        int id;
+                        bool expectsValue;
+                };
+
+                char prefix;
+                FamilyHandler handler;
+                std::vector<Member> members;
+                NameIndex index;
+        };
+
+        /**
+         * The result of classifying a single token. 'flag' is the length of
+         * the part naming the option, the value runs from 'valueFirst' to
+         * the end of the token or is missing if it is 'npos'. 'family' and
+         * 'member' are the indices of a family member or -1, 'slot' is the
+         * index in 'options' or -1. The 'Option' itself is only built when
+         * the token is added to the result.
+         */
+        struct Token {
+                Error error = Error::ExpectedOption;
+                std::size_t flag = 0;
+                std::size_t valueFirst = std::string::npos;
+                char key = '\0';
+                int choice = 0;
+                int family = -1;
+                int member = -1;
+                int slot = -1;
+        };
+
+        /**
+         * Checks whether 'token' is two characters long and starts with a '-'
+         * character.
+         *
+         * @param The token to check
+         *
+         * @return True if the token is two characters long and starts with '-'
+         */
+        bool isOption(const std::string& token) const;
+
+        /**
+         * A unit suffix and the factor it scales a number by.
+         */
+        struct Unit {
+                const char* suffix;
+                std::uint64_t factor;
+        };
+
+        static constexpr char completionMagic[8] = {
+                'p', 'i', 'c', 'o', 'c', 'm', 'p', '1'
+        };
+
+        static constexpr char cacheMagic[8] = {
+                'p', 'i', 'c', 'o', 'c', 'c', 'h', '1'
+        };
+
+        /**
+         * A streaming 64 bit hash with the output of XXH64.
+         */
+        class Hasher {
+        public:
+                explicit Hasher(std::uint64_t seed = 0);
+
+                /**
+                 * Hashes 'size' bytes at 'data'.
+                 */
+                void update(const void* data, std::size_t size);
+
+                /**
+                 * Hashes the size of 'text' followed by its characters, so
+                 * consecutive strings can't run into each other.
+                 */
+                void update(const std::string& text);
+
+                /**
+                 * Returns the hash of everything passed to 'update' so far.
+                 */
+                std::uint64_t digest() const;
+
+        private:
+                static std::uint64_t round(std::uint64_t lane,
+                                std::uint64_t input);
+                static std::uint64_t read64(const unsigned char* bytes);
+
+                std::uint64_t lanes[4];
+                unsigned char buffer[32];
+                std::size_t buffered = 0;
+                std::uint64_t total = 0;
+                std::uint64_t seed;
+        };
+
+        static constexpr Unit sizeUnits[] = {
+                { "", 1 }, { "B", 1 },
+                { "K", 1ull << 10 }, { "KiB", 1ull << 10 },
+                { "M", 1ull << 20 }, { "MiB", 1ull << 20 },
+                { "G", 1ull << 30 }, { "GiB", 1ull << 30 },
+                { "T", 1ull << 40 }, { "TiB", 1ull << 40 },
+                { "kB", 1000ull }, { "MB", 1000000ull },
+                { "GB", 1000000000ull }, { "TB", 1000000000000ull },
+        };
+
+        static constexpr Unit durationUnits[] = {
+                { "", 1000000000ull }, { "s", 1000000000ull },
+                { "ns", 1ull }, { "us", 1000ull }, { "ms", 1000000ull },
+                { "m", 60000000000ull }, { "h", 3600000000000ull },
+        };
+
+        static constexpr Unit countUnits[] = {
+                { "", 1ull }, { "k", 1000ull }, { "M", 1000000ull },
+                { "G", 1000000000ull },
+        };
+
+        /**
+         * Parses a number followed by one of the suffixes in 'units' and
+         * scales it by the factor of that suffix.
+         *
+         * @param first The first character of the text
+         * @param last One past the last character of the text
+         * @param units The table of accepted suffixes
+         * @param value Receives the scaled number
+         *
+         * @return True if the text is valid and the result doesn't overflow
+         */
+        template <std::size_t N>
+        static bool parseScaled(const char* first, const char* last,
+                        const Unit (&units)[N], std::uint64_t& value);
+
+        /**
+         * Scales 'number' by the factor of the suffix in [first, last).
+         *
+         * @return True if the suffix is in 'units' and the result doesn't
+         *         overflow
+         */
+        template <std::size_t N>
+        static bool scale(std::uint64_t number, const char* first,
+                        const char* last, const Unit (&units)[N],
+                        std::uint64_t& value);
+
+        /**
+         * Adds an enumerated option and builds the perfect hash table of its
+         * allowed values.
+         */
+        void addChoices(const char& key, std::vector<std::string> names,
+                        std::vector<int> values);
+
+        /**
+         * Looks up 'name' in the allowed values of 'set'.
+         *
+         * @return The index of the value or -1 if it isn't allowed
+         */
+        static int findChoice(const ChoiceSet& set, const char* name,
+                        std::size_t size);
+
+        static std::uint32_t hash(const char* name, std::size_t size,
+                        std::uint32_t seed);
+
+        /**
+         * Records an error found by 'parse'.
+         *
+         * @return True if 'parse' should stop
+         */
+        bool fail(Error kind, int index, char key);
+
+        /**
+         * Appends the arguments from 'first' to 'last' to 'args', replacing
+         * '@file' tokens by the contents of the file.
+         *
+         * @return True if no limit was exceeded and every file was read
+         */
+        bool expand(char* const* first, char* const* last,
+                        std::vector<std::string>& args);
+
+        /**
+         * Moves 'token' to 'args' or, if it is '@file', appends the tokens in
+         * the file.
+         *
+         * @return True if no limit was exceeded and every file was read
+         */
+        bool expandToken(std::string token, std::size_t depth,
+                        std::vector<std::string>& args);
+
+        /**
+         * Splits the contents of a response file like 'split' while reading
+         * it and passes each token to 'expandToken', so the limits are
+         * checked before the whole file is in memory.
+         *
+         * @return True if no limit was exceeded and the file was read
+         */
+        bool expandFile(std::istream& file, const std::string& path,
+                        std::size_t depth, std::vector<std::string>& args);
+
+        /**
+         * Returns the length of the longest token that can pass
+         * 'maxValueBytes', i.e. the limit plus the longest flag.
+         */
+        std::size_t maxTokenBytes() const;
+
+        /**
+         * Parses the options in 'args' and appends them to 'result'.
+         *
+         * @param args The options without the program name
+         * @param result Receives the parsed options
+         *
+         * @return True if successful
+         */
+        bool parseTokens(const std::vector<std::string>& args,
+                        std::vector<Option>& result);
+
+        /**
+         * Publishes a snapshot with the live options from the current one,
+         * replaced by the ones in 'changes'. Has to be called with 'parsing'
+         * locked.
+         */
+        void publish(const std::vector<Option>& changes);
+
+        /**
+         * Returns a copy of the frozen schema without parsed options, which
+         * other threads can parse with without touching this parser.
+         */
+        std::unique_ptr<OptionParser> copySchema() const;
+
+        /**
+         * Splits 'text' at whitespace, skipping comments that start with '#'.
+         */
+        static std::vector<std::string> split(const std::string& text);
+
+        /**
+         * Builds the lookup structures of the keys, the long option names
+         * and the option families.
+         */
+        void buildIndex();
+
+        /**
+         * Gives every option with a code point key a byte from 0x80 to 0xff
+         * that isn't a key, so the code point keys share the index of
+         * 'parsed' with the others. ASCII bytes are left to the user.
+         *
+         * @return False if there are too many code point keys
+         */
+        bool assignKeys();
+
+        /**
+         * Returns the index in 'options' of the option with 'codePoint' as
+         * its key or -1.
+         */
+        int findCodePoint(char32_t codePoint) const;
+
+        /**
+         * Returns the byte 'assignKeys' gave 'codePoint' or '\0'.
+         */
+        char keyOf(char32_t codePoint) const;
+
+        /**
+         * Decodes the UTF-8 sequence at the start of 'text'. 'text' has to
+         * be followed by a NUL byte if it is shorter than 4 bytes.
+         *
+         * @param length Receives the length of the sequence or 0 if it is
+         *               invalid
+         *
+         * @return The code point
+         */
+        static char32_t decode(const char* text, std::size_t& length);
+
+        /**
+         * Writes the UTF-8 encoding of 'codePoint' to 'text'.
+         *
+         * @return The number of bytes written
+         */
+        static std::size_t encode(char32_t codePoint, char (&text)[4]);
+
+        /**
+         * Returns the hash of the options added to the parser, the limits,
+         * whether errors are collected or skipped and the working directory,
+         * followed by 'argv'.
+         */
+        std::uint64_t cacheFingerprint(int argc, char* argv[]);
+
+        /**
+         * Replaces 'parsed' by the result stored for 'argv' in the cache
+         * file if its inputs didn't change.
+         *
+         * @return True if the result was found
+         */
+        bool loadCache(int argc, char* argv[]);
+
+        /**
+         * Writes 'bytes' to a temporary file next to 'path' and renames it
+         * to 'path', so readers that map the file never see it partially
+         * written. Only available on unix.
+         *
+         * @return True if the file was replaced
+         */
+        static bool replaceFile(const std::string& path, const std::string& bytes);
+
+        /**
+         * Checks whether an option read from the cache file belongs to the
+         * schema and has a value 'classify' would accept, then replaces its
+         * fields other than the value, the choice and the index by those of
+         * the schema.
+         *
+         * @return True if the option is valid
+         */
+        bool acceptsCached(Option& option) const;
+
+        /**
+         * Reads the modification time and size of a file.
+         *
+         * @return True if the file exists
+         */
+        static bool stamp(const std::string& path, std::int64_t& mtime,
+                        std::int64_t& size);
+
+        /**
+         * Prints and records a duplicate found by 'freeze'.
+         *
+         * @param flag The duplicate as it would appear in 'argv'
+         * @param key The key recorded in the diagnostic
+         *
+         * @return False
+         */
+        bool duplicate(const std::string& flag, const char& key);
+
+        /**
+         * Finds the first parsed option with 'key' or 'name' that hasn't
+         * been popped.
+         */
+        std::vector<Option>::iterator next(const char& key);
+        std::vector<Option>::iterator next(const std::string& name);
+
+        /**
+         * Groups 'parsed' by key with a counting sort.
+         */
+        void buildKeyIndex();
+
+        /**
+         * Groups the parsed options with a long name by their option.
+         */
+        void buildNameIndex();
+
+        /**
+         * Returns the table used by 'valueAt' for 'key', building it if it
+         * doesn't exist yet. Entry i is the index of the last occurrence of
+         * 'key' in 'parsed' at or before position i or -1.
+         */
+        const std::vector<int>& scope(const char& key);
+
+        /**
+         * Returns the table of 'key' or nullptr if it wasn't built.
+         */
+        const std::vector<int>* findScope(const char& key) const;
+
+        /**
+         * Looks up the value in effect at position 'index' in a table
+         * returned by 'scope'.
+         */
+        const std::string& scopedValue(const std::vector<int>& last,
+                        int index) const;
+
+        /**
+         * Freezes the schema if it changed.
+         *
+         * @return True if the schema is valid
+         */
+        bool prepare();
+
+        /**
+         * Looks up the option a token names and checks its value without
+         * printing anything or calling family handlers.
+         *
+         * @param token The token to classify
+         * @param result Receives the option or the error
+         *
+         * @return True if the token is a valid option
+         */
+        bool classify(const std::string& token, Token& result) const;
+
+        /**
+         * Prints the error of a token that failed to classify.
+         */
+        void report(const std::string& token, const Token& result) const;
+
+        /**
+         * Returns the stream that errors of the schema and of parsing get
+         * printed to, 'std::cout' or a stream that drops everything if the
+         * parser is lenient.
+         */
+        std::ostream& out() const;
+
+        /**
+         * Finds the long option whose name is closest to 'name'. This only
+         * runs after a long option wasn't recognized.
+         *
+         * @return The option or nullptr if no name is close enough
+         */
+        const Option* suggest(const std::string& name) const;
+
+        /**
+         * Computes the edit distance between a pattern of at most 64
+         * characters and 'text' with Myers' bit-parallel algorithm.
+         *
+         * @param peq The positions of each character in the pattern
+         * @param size The length of the pattern
+         */
+        static std::size_t editDistance(const std::uint64_t (&peq)[256],
+                        std::size_t size, const std::string& text);
+
+        std::vector<Option> options;
+        std::vector<Option> parsed;
+        std::vector<std::pair<char, std::vector<int>>> scopes;
+
+        /**
+         * The indices of 'parsed' grouped by key. The options with key k are
+         * byKey[offsets[k]] to byKey[offsets[k + 1]], 'cursors' points at
+         * the first one of each key that might not be popped yet.
+         */
+        std::array<std::uint32_t, 257> offsets {};
+        std::array<std::uint32_t, 256> cursors {};
+        std::vector<std::uint32_t> byKey;
+
+        /**
+         * The indices of the parsed options with a long name grouped the same
+         * way by the index of their option in 'options', since they share
+         * the key '\0'. Built again when the schema is frozen again.
+         */
+        std::vector<std::uint32_t> nameOffsets;
+        std::vector<std::uint32_t> nameCursors;
+        std::vector<std::uint32_t> byName;
+        bool namesIndexed = false;
+        std::vector<ChoiceSet> choiceSets;
+        NameIndex nameIndex;
+        std::vector<Family> families;
+
+        /**
+         * Entry k is the index in 'options' of the option with key k, -1 if
+         * there is none or -2 - f if k is the prefix of family f.
+         */
+        std::array<std::int32_t, 256> keySlots {};
+
+        /**
+         * A two-level table of the code point keys. Code point c is the key
+         * of options[codePointBlocks[codePointPages[c >> 8] - 1][c & 255]],
+         * pages without keys are 0 and unused entries -1.
+         */
+        std::vector<std::uint16_t> codePointPages;
+        std::vector<std::array<std::int32_t, 256>> codePointBlocks;
+        bool indexed = false;
+        bool registered = false;
+
+        std::string program;
+
+        /**
+         * The epoch a reader entered at or 0 if unused, on a cache line of
+         * its own.
+         */
+        struct alignas(64) ReaderSlot {
+                std::atomic<std::uint64_t> epoch { 0 };
+        };
+
+        /**
+         * The state used by other threads. It lives on the heap, so moving
+         * the parser doesn't move it under their feet.
+         */
+        struct Shared {
+                /**
+                 * Stops watching the config file and frees the snapshots.
+                 */
+                ~Shared();
+
+                /**
+                 * Marks a free reader slot with the current epoch and loads
+                 * the snapshot of 'slot'. Waits if every reader slot is in
+                 * use.
+                 */
+                SnapshotRef pin(const std::atomic<const Snapshot*>& slot);
+
+                /**
+                 * Publishes 'next' in 'slot' and frees the snapshots that
+                 * were replaced before the oldest reader entered. Needs
+                 * 'parsing' to be locked.
+                 */
+                void replace(std::atomic<const Snapshot*>& slot,
+                                const Snapshot* next);
+
+                /**
+                 * Parses the config file with 'schema' and publishes its
+                 * options.
+                 *
+                 * @return True if successful
+                 */
+                bool reload();
+
+                /**
+                 * Waits for changes of the config file until 'stopFd' is
+                 * signaled or waiting fails, then clears 'watching'.
+                 */
+                void watchLoop();
+
+                static constexpr std::size_t readerSlots = 64;
+
+                std::atomic<const Snapshot*> live { nullptr };
+                std::atomic<const Snapshot*> config { nullptr };
+                std::array<ReaderSlot, readerSlots> readers;
+                std::atomic<std::uint64_t> epoch { 1 };
+                std::vector<std::pair<std::uint64_t, const Snapshot*>> retired;
+                std::mutex parsing;
+
+                /**
+                 * The copy of the schema 'update' and 'reload' parse with,
+                 * so they don't touch the parser other threads use.
+                 */
+                std::unique_ptr<OptionParser> schema;
+
+                std::string configPath;
+                std::thread watcher;
+                std::atomic<bool> watching { false };
+                int watchFd = -1;
+                int stopFd = -1;
+        };
+
+        /**
+         * Owns the shared state. A copy of a parser starts with new state
+         * without snapshots or a watched file, a move takes it along.
+         */
+        class SharedState {
+        public:
+                SharedState();
+                SharedState(const SharedState& other);
+                SharedState(SharedState&& other) noexcept = default;
+                SharedState& operator=(const SharedState& other);
+                SharedState& operator=(SharedState&& other) noexcept = default;
+
+                Shared* operator->() const;
+
+        private:
+                std::unique_ptr<Shared> state;
+        };
+
+        SharedState shared;
+
+        std::array<Diagnostic, maxDiagnostics> diagnosticBuffer;
+        std::size_t errors = 0;
+        bool collect = false;
+        // Skips invalid tokens without printing or recording them, set by
+        // 'process' since the command line belongs to someone else
+        bool lenient = false;
+        Limits limits;
+
+        std::string cachePath;
+        char cacheInputKey = '\0';
+        std::uint64_t cacheKey = 0;
+        bool fromCache = false;
+        std::vector<std::string> responseFiles;
+};
+
+/**
+ * Keeps the classification of a command line that is being edited, e.g. in
+ * an interactive shell. Values are always inline, so every token is
+ * classified on its own and an edit only reclassifies the token it touches.
+ * Nothing gets printed and family handlers aren't called. The parser has to
+ * outlive this and its options must not change while it is used. If the
+ * options can't be frozen, every token is invalid with the error 'freeze'
+ * found.
+ */
+class OptionParser::Incremental {
+public:
+        explicit Incremental(OptionParser& parser);
+
+        /**
+         * Inserts a token before 'position'.
+         */
+        void insert(std::size_t position, const std::string& token);
+
+        /**
+         * Replaces the token at 'position'.
+         */
+        void replace(std::size_t position, const std::string& token);
+
+        /**
+         * Removes the token at 'position'.
+         */
+        void erase(std::size_t position);
+
+        /**
+         * Returns the number of tokens.
+         */
+        std::size_t size() const;
+
+        /**
+         * Checks whether the token at 'position' is a valid option. Use
+         * 'error' to find out what is wrong with an invalid one.
+         */
+        bool valid(std::size_t position) const;
+
+        Error error(std::size_t position) const;
+
+        /**
+         * Returns the key of the option at 'position' or '\0' for long
+         * options and tokens that aren't options.
+         */
+        char key(std::size_t position) const;
+
+        /**
+         * Returns the value of the option at 'position'.
+         */
+        const std::string& value(std::size_t position) const;
+
+        /**
+         * Returns the number of invalid tokens.
+         */
+        std::size_t errorCount() const;
+
+        /**
+         * Checks whether the options of the parser could be frozen.
+         */
+        bool schemaValid() const;
+
+private:
+        struct Entry {
+                Token token;
+                std::string value;
+                bool valid;
+        };
+
+        Entry classify(const std::string& token) const;
+
+        OptionParser& parser;
+        std::vector<Entry> entries;
+        std::size_t errors = 0;
+        bool frozen = false;
+        Error schemaError = Error::DuplicateOption;
+};
+
+template <typename E, std::size_t N>
+void OptionParser::add(const char& key, const Choice<E> (&choices)[N])
+{
+        std::vector<std::string> names;
+        std::vector<int> values;
+
+        for (const Choice<E>& choice : choices) {
+                names.push_back(choice.name);
+                values.push_back(static_cast<int>(choice.value));
+        }
+
+        addChoices(key, std::move(names), std::move(values));
+}
+
+template <typename E>
+bool OptionParser::popChoice(const char& key, E& value)
+{
+        auto it = next(key);
+
+        if (it == parsed.end() || (*it).choices < 0) {
+                return false;
+        }
+
+        value = static_cast<E>((*it).choice);
+        (*it).popped = true;
+
+        return true;
+}
+
+constexpr OptionParser::Pattern::Pattern(const char* pattern)
+{
+        // Each atom is a position of a Glushkov automaton, position 0 is
+        // the start. A DFA state is the set of positions it stands for.
+        Set sets[maxAtoms + 1] = {};
+        bool optional[maxAtoms + 1] = {};
+        bool repeated[maxAtoms + 1] = {};
+        std::size_t count = 0;
+
+        for (const char* it = pattern; *it; ) {
+                if (++count > maxAtoms) {
+                        throw "picoarg: pattern has too many atoms";
+                }
+
+                Set& set = sets[count];
+                char c = *it++;
+
+                if (c == '.') {
+                        insert(set, 0, 255);
+                } else if (c == '[') {
+                        it = parseClass(it, set);
+                } else if (c == '\\' && *it) {
+                        c = *it++;
+                        if (c == 'd' || c == 'w' || c == 'x') {
+                                insert(set, '0', '9');
+                        }
+                        if (c == 'w' || c == 'x') {
+                                insert(set, 'a', c == 'w' ? 'z' : 'f');
+                                insert(set, 'A', c == 'w' ? 'Z' : 'F');
+                        }
+                        if (c == 'w') {
+                                insert(set, '_', '_');
+                        } else if (c != 'd' && c != 'x') {
+                                insert(set, c, c);
+                        }
+                } else {
+                        insert(set, c, c);
+                }
+
+                optional[count] = *it == '?' || *it == '*';
+                repeated[count] = *it == '*' || *it == '+';
+                it += optional[count] || repeated[count] ? 1 : 0;
+        }
+
+        std::uint32_t follow[maxAtoms + 1] = {};
+        std::uint32_t accepts = 0;
+
+        for (std::size_t p = 0; p <= count; ++p) {
+                follow[p] = repeated[p] ? 1u << p : 0;
+
+                std::size_t q = p + 1;
+                for (; q <= count; ++q) {
+                        follow[p] |= 1u << q;
+                        if (!optional[q]) {
+                                break;
+                        }
+                }
+
+                accepts |= q > count ? 1u << p : 0;
+        }
+
+        std::uint32_t states[maxStates] = { 0, 1 };
+        std::size_t stateCount = 2;
+
+        for (std::size_t state = 1; state < stateCount; ++state) {
+                std::uint32_t reachable = 0;
+
+                for (std::size_t p = 0; p <= count; ++p) {
+                        reachable |= states[state] & (1u << p) ? follow[p] : 0;
+                }
+
+                accepting[state] = (states[state] & accepts) != 0;
+
+                for (unsigned c = 0; c < 256; ++c) {
+                        std::uint32_t target = 0;
+
+                        for (std::size_t q = 1; q <= count; ++q) {
+                                if (reachable & (1u << q) && contains(sets[q], c)) {
+                                        target |= 1u << q;
+                                }
+                        }
+
+                        std::size_t found = 0;
+                        while (found < stateCount && states[found] != target) {
+                                ++found;
+                        }
+
+                        if (found == stateCount) {
+                                if (stateCount == maxStates) {
+                                        throw "picoarg: pattern needs too many states";
+                                }
+                                states[stateCount++] = target;
+                        }
+
+                        next[state][c] = static_cast<std::uint8_t>(found);
+                }
+        }
+}
+
+constexpr void OptionParser::Pattern::insert(Set& set, unsigned char first,
+                unsigned char last)
+{
+        for (unsigned c = first; c <= last; ++c) {
+                set[c / 64] |= std::uint64_t(1) << (c % 64);
+        }
+}
+
+constexpr bool OptionParser::Pattern::contains(const Set& set, unsigned char c)
+{
+        return (set[c / 64] >> (c % 64)) & 1;
+}
+
+constexpr const char* OptionParser::Pattern::parseClass(const char* it, Set& set)
+{
+        bool negated = *it == '^';
+        it += negated ? 1 : 0;
+
+        Set members = {};
+        for (bool first = true; *it && (*it != ']' || first); first = false) {
+                char low = *it++;
+
+                if (low == '\\' && *it) {
+                        low = *it++;
+                }
+
+                char high = low;
+                if (*it == '-' && it[1] && it[1] != ']') {
+                        high = it[1];
+                        it += 2;
+                }
+
+                insert(members, low, high);
+        }
+
+        if (*it != ']') {
+                throw "picoarg: unterminated character class";
+        }
+
+        for (unsigned c = 0; c < 256; ++c) {
+                if (contains(members, c) != negated) {
+                        insert(set, c, c);
+                }
+        }
+
+        return it + 1;
+}
+
+/**
+ * Declares an option next to the code that uses it. The descriptor is placed
+ * into the 'picoarg_options' section by the linker, there are no static
+ * constructors involved. 'OptionParser::addRegistered' adds the declared
+ * options to a parser, the one returned by 'OptionParser::process' has them.
+ * 'id' has to be unique within the translation unit. Only available for ELF
+ * targets, elsewhere the declared options are ignored.
+ *
+ * Example: PICOARG_OPTION(verbose, 'v', "verbose", false);
+ */
+#if defined(__ELF__)
+#define PICOARG_OPTION(id, key, name, expectsValue) \
+        __attribute__((used, section("picoarg_options"), aligned(8))) \
+        static constexpr OptionParser::Descriptor picoarg_option_##id \
+                = { key, name, expectsValue }
+#else
+#define PICOARG_OPTION(id, key, name, expectsValue) \
+        static constexpr OptionParser::Descriptor picoarg_option_##id \
+                = { key, name, expectsValue }
+#endif
+
+#endif // _PICOARG_HPP
+
+#ifdef PICOARG_IMPL
+
+#include <charconv>
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string_view>
+
+#if defined(__unix__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#endif
+
+#if defined(__ELF__)
+extern "C" {
+extern const OptionParser::Descriptor __start_picoarg_options[]
+        __attribute__((weak));
+extern const OptionParser::Descriptor __stop_picoarg_options[]
+        __attribute__((weak));
+}
+#endif
+
+bool OptionParser::parse(int& argc, char* argv[])
+{
+        std::lock_guard<std::mutex> lock(shared->parsing);
+        std::vector<std::string> args;
+        program = argv[0];
+        errors = 0;
+
+        scopes.clear();
+        responseFiles.clear();
+        fromCache = !cachePath.empty() && loadCache(argc, argv);
+
+        if (!fromCache && (!expand(argv + 1, argv + argc, args)
+                                || !parseTokens(args, parsed))) {
+                return false;
+        }
+
+        buildKeyIndex();
+
+        if (std::any_of(options.begin(), options.end(),
+                        [](const Option& option) { return option.live; })) {
+                publish(parsed);
+                shared->schema = copySchema();
+        }
+
+        return true;
+}
+
+bool OptionParser::parseTokens(const std::vector<std::string>& args,
+                std::vector<Option>& result)
+{
+        errors = 0;
+
+        if (!prepare()) {
+                return false;
+        }
+
+        std::vector<std::size_t> occurrences(options.size());
+        std::vector<std::vector<std::size_t>> memberOccurrences;
+        std::size_t valueBytes = 0;
+
+        for (const Family& family : families) {
+                memberOccurrences.emplace_back(family.members.size());
+        }
+
+        if (args.size() > limits.maxTokens) {
+                out() << program << ": more than " << limits.maxTokens
+                        << " arguments" << std::endl;
+                fail(Error::TooManyTokens, int(limits.maxTokens) + 1, '\0');
+                return false;
+        }
+
+        result.reserve(result.size() + args.size());
+
+        for(auto it = args.begin(); it < args.end(); ++it) {
+                std::size_t position = it - args.begin();
+                int index = static_cast<int>(position) + 1;
+                Token token;
+
+                if (!classify(*it, token)) {
+                        if (lenient) {
+                                continue;
+                        }
+
+                        report(*it, token);
+                        if (fail(token.error, index, token.key)) {
+                                return false;
+                        }
+                        continue;
+                }
+
+                bool hasValue = token.valueFirst != std::string::npos;
+                valueBytes += hasValue ? it->size() - token.valueFirst : 0;
+                if (valueBytes > limits.maxValueBytes) {
+                        out() << program << ": values longer than "
+                                << limits.maxValueBytes << " bytes" << std::endl;
+                        fail(Error::TooManyValueBytes, index, token.key);
+                        return false;
+                }
+
+                std::size_t& count = token.family >= 0
+                        ? memberOccurrences[token.family][token.member]
+                        : occurrences[token.slot];
+
+                if (++count > limits.maxOccurrences) {
+                        out() << program << ": option '"
+                                << it->substr(0, token.flag) << "' given more than "
+                                << limits.maxOccurrences << " times" << std::endl;
+                        fail(Error::TooManyOccurrences, index, token.key);
+                        return false;
+                }
+
+                if (token.family >= 0) {
+                        const Family& family = families[token.family];
+                        int id = family.members[token.member].id;
+
+                        std::string value = hasValue
+                                ? it->substr(token.valueFirst) : std::string();
+
+                        if (!family.handler(id, value) && !lenient) {
+                                token.error = Error::RejectedMember;
+                                report(*it, token);
+                                if (fail(token.error, index, token.key)) {
+                                        return false;
+                                }
+                        }
+                        continue;
+                }
+
+                result.push_back(options[token.slot]);
+                Option& option = result.back();
+
+                if (hasValue) {
+                        option.value.assign(*it, token.valueFirst, std::string::npos);
+                }
+
+                option.choice = token.choice;
+                option.index = index;
+        }
+
+        return errors == 0;
+}
+
+bool OptionParser::expand(char* const* first, char* const* last,
+                std::vector<std::string>& args)
+{
+        // Response files only add to it
+        args.reserve(std::min<std::size_t>(last - first, limits.maxTokens));
+
+        for (; first != last; ++first) {
+                if (!expandToken(*first, 0, args)) {
+                        return false;
+                }
+        }
+
+        return true;
+}
+
+bool OptionParser::expandToken(std::string token, std::size_t depth,
+                std::vector<std::string>& args)
+{
+        int index = static_cast<int>(args.size()) + 1;
+
+        if (!limits.responseFiles || token.size() < 2 || token[0] != '@') {
+                if (args.size() >= limits.maxTokens) {
+                        out() << program << ": more than "
+                                << limits.maxTokens << " arguments"
+                                << std::endl;
+                        fail(Error::TooManyTokens, index, '\0');
+                        return false;
+                }
+
+                args.push_back(std::move(token));
+                return true;
+        }
+
+        if (depth >= limits.maxDepth) {
+                out() << program << ": response files nested deeper"
+                        << " than " << limits.maxDepth << std::endl;
+                fail(Error::TooDeeplyNested, index, '\0');
+                return false;
+        }
+
+        std::string path = token.substr(1);
+        std::ifstream file(path);
+
+        if (!file) {
+                out() << program << ": can't read '" << path << "'"
+                        << std::endl;
+                fail(Error::UnreadableFile, index, '\0');
+                return false;
+        }
+
+        responseFiles.push_back(path);
+        return expandFile(file, path, depth + 1, args);
+}
+
+bool OptionParser::expandFile(std::istream& file, const std::string& path,
+                std::size_t depth, std::vector<std::string>& args)
+{
+        std::size_t maxBytes = maxTokenBytes();
+        std::string token;
+        bool comment = false;
+        char buffer[4096];
+
+        while (file.read(buffer, sizeof(buffer)) || file.gcount() > 0) {
+                for (std::streamsize i = 0; i < file.gcount(); ++i) {
+                        char c = buffer[i];
+
+                        if (comment) {
+                                comment = c != '\n';
+                        } else if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+                                if (!token.empty()
+                                                && !expandToken(std::move(token), depth, args)) {
+                                        return false;
+                                }
+                                token.clear();
+                        } else if (c == '#' && token.empty()) {
+                                comment = true;
+                        } else if (token.size() < maxBytes) {
+                                token += c;
+                        } else {
+                                out() << program << ": '" << path
+                                        << "' has a token longer than " << maxBytes
+                                        << " bytes" << std::endl;
+                                fail(Error::TooManyValueBytes,
+                                                static_cast<int>(args.size()) + 1, '\0');
+                                return false;
+                        }
+                }
+        }
+
+        if (file.bad()) {
+                out() << program << ": can't read '" << path << "'"
+                        << std::endl;
+                fail(Error::UnreadableFile, static_cast<int>(args.size()) + 1, '\0');
+                return false;
+        }
+
+        return token.empty() || expandToken(std::move(token), depth, args);
+}
+
+std::size_t OptionParser::maxTokenBytes() const
+{
+        // A value can't start before the end of the longest flag, '--name='
+        std::size_t flag = 5;
+
+        for (const Option& option : options) {
+                flag = std::max(flag, option.name.size() + 3);
+        }
+
+        for (const Family& family : families) {
+                for (const Family::Member& member : family.members) {
+                        flag = std::max(flag, member.name.size() + 3);
+                }
+        }
+
+        return limits.maxValueBytes > SIZE_MAX - flag
+                ? SIZE_MAX : limits.maxValueBytes + flag;
+}
+
+bool OptionParser::prepare()
+{
+        return indexed || freeze();
+}
+
+bool OptionParser::classify(const std::string& token, Token& result) const
+{
+        result.flag = token.size();
+
+        if (!isOption(token)) {
+                result.error = Error::ExpectedOption;
+                return false;
+        }
+
+        bool isLong = token[1] == '-';
+        char key = isLong ? '\0' : token[1];
+        result.key = key;
+
+        int keySlot = isLong ? -1 : keySlots[static_cast<unsigned char>(key)];
+        std::string::size_type keyEnd = 2;
+
+        // Only bytes that aren't keys can start a code point key
+        if (keySlot == -1 && (key & 0x80)) {
+                std::size_t length;
+                char32_t codePoint = decode(token.c_str() + 1, length);
+
+                if (length > 0) {
+                        keySlot = findCodePoint(codePoint);
+                        keyEnd = 1 + length;
+                }
+        }
+
+        auto familyIt = keySlot <= -2
+                ? families.begin() + (-2 - keySlot) : families.end();
+
+        // Long options and family members carry their value after a '='
+        std::string::size_type equals = isLong || familyIt != families.end()
+                ? token.find('=', 2) : keyEnd;
+        bool hasValue = equals < token.size();
+        result.flag = std::min(equals, token.size());
+
+        bool expectsValue;
+        const Option* option = nullptr;
+
+        if (familyIt != families.end()) {
+                int match = (*familyIt).index.find(token.data() + 2,
+                                result.flag - 2, false);
+
+                if (match < 0) {
+                        result.error = Error::UnrecognizedOption;
+                        return false;
+                }
+
+                result.family = static_cast<int>(familyIt - families.begin());
+                result.member = match;
+                expectsValue = (*familyIt).members[match].expectsValue;
+        } else {
+                int match = isLong
+                        ? nameIndex.find(token.data() + 2, result.flag - 2, true)
+                        : -1;
+
+                if (match == -2) {
+                        result.error = Error::AmbiguousOption;
+                        return false;
+                }
+
+                if (!isLong) {
+                        match = keySlot;
+                }
+
+                auto optionIt = match < 0
+                        ? options.end() : options.begin() + match;
 
                 if (optionIt == options.end()) {
-                        std::cout << argv[0] << ": unrecognized option '-"
-                                << key << "'" << std::endl;
+                        result.error = Error::UnrecognizedOption;
+                        return false;
+                }
+
+                option = &*optionIt;
+                result.slot = static_cast<int>(optionIt - options.begin());
+                result.key = (*option).key;
+                expectsValue = (*option).expectsValue;
+        }
+
+        if (expectsValue && !hasValue) {
+                result.error = Error::MissingValue;
+                return false;
+        }
+
+        if (!expectsValue && hasValue) {
+                result.error = Error::UnexpectedValue;
+                return false;
+        }
+
+        if (hasValue) {
+                result.valueFirst = isLong || !option ? equals + 1 : keyEnd;
+        }
+
+        const char* value = token.data() + (hasValue ? result.valueFirst : token.size());
+        std::size_t size = token.data() + token.size() - value;
+
+        if (option && (*option).choices >= 0) {
+                const ChoiceSet& set = choiceSets[(*option).choices];
+                int choice = findChoice(set, value, size);
+
+                if (choice < 0) {
+                        result.error = Error::InvalidChoice;
+                        return false;
+                }
+
+                result.choice = set.values[choice];
+        }
+
+        if (option && (*option).pattern) {
+                if (!(*option).pattern->matches(value, value + size)) {
+                        result.error = Error::InvalidValue;
+                        return false;
+                }
+        }
+
+        return true;
+}
+
+std::ostream& OptionParser::out() const
+{
+        // One per thread, a failed write still sets the state of the stream
+        thread_local std::ostream none(nullptr);
+
+        return lenient ? none : std::cout;
+}
+
+void OptionParser::report(const std::string& token, const Token& result) const
+{
+        std::string flag = token.substr(0, result.flag);
+        std::string value = result.valueFirst < token.size()
+                ? token.substr(result.valueFirst) : std::string();
+        out() << program << ": ";
+
+        switch (result.error) {
+        case Error::ExpectedOption:
+                out() << "expected an option, found '" << token << "'";
+                break;
+
+        case Error::UnrecognizedOption: {
+                bool isLong = token[1] == '-';
+                const Option* suggestion = isLong ? suggest(flag.substr(2)) : nullptr;
+
+                out() << "unrecognized option '" << flag << "'";
+                if (suggestion) {
+                        out() << ", did you mean '--" << suggestion->name
+                                << "'?";
+                }
+                break;
+        }
+
+        case Error::AmbiguousOption:
+                out() << "option '" << flag << "' is ambiguous";
+                break;
+
+        case Error::MissingValue:
+                out() << "missing value after '" << flag << "'";
+                break;
+
+        case Error::UnexpectedValue:
+                out() << "option '" << flag << "' doesn't allow a value";
+                break;
+
+        case Error::InvalidChoice: {
+                const ChoiceSet& set = choiceSets[options[result.slot].choices];
+
+                out() << "invalid value '" << value
+                        << "' for '" << flag << "' (expected ";
+                for (std::size_t i = 0; i < set.names.size(); ++i) {
+                        out() << (i ? "|" : "") << set.names[i];
+                }
+                out() << ")";
+                break;
+        }
+
+        case Error::InvalidValue:
+                out() << "invalid value '" << value
+                        << "' for '" << flag << "'";
+                break;
+
+        case Error::RejectedMember:
+                out() << "option '" << token << "' was rejected";
+                break;
+
+        case Error::InvalidInput:
+                out() << "invalid input '" << token << "'";
+                break;
+
+        default:
+                out() << "invalid option '" << token << "'";
+                break;
+        }
+
+        out() << std::endl;
+}
+
+OptionParser::Incremental::Incremental(OptionParser& parser)
+        : parser(parser)
+{
+        std::size_t before = parser.errors;
+        frozen = parser.prepare();
+
+        if (!frozen && before < maxDiagnostics) {
+                schemaError = parser.diagnosticBuffer[before].kind;
+        }
+}
+
+void OptionParser::Incremental::insert(std::size_t position,
+                const std::string& token)
+{
+        Entry entry = classify(token);
+        errors += entry.valid ? 0 : 1;
+        entries.insert(entries.begin() + position, std::move(entry));
+}
+
+void OptionParser::Incremental::replace(std::size_t position,
+                const std::string& token)
+{
+        Entry& entry = entries[position];
+        errors -= entry.valid ? 0 : 1;
+        entry = classify(token);
+        errors += entry.valid ? 0 : 1;
+}
+
+void OptionParser::Incremental::erase(std::size_t position)
+{
+        errors -= entries[position].valid ? 0 : 1;
+        entries.erase(entries.begin() + position);
+}
+
+std::size_t OptionParser::Incremental::size() const
+{
+        return entries.size();
+}
+
+bool OptionParser::Incremental::valid(std::size_t position) const
+{
+        return entries[position].valid;
+}
+
+OptionParser::Error OptionParser::Incremental::error(std::size_t position) const
+{
+        return entries[position].token.error;
+}
+
+char OptionParser::Incremental::key(std::size_t position) const
+{
+        return entries[position].token.key;
+}
+
+const std::string& OptionParser::Incremental::value(std::size_t position) const
+{
+        return entries[position].value;
+}
+
+std::size_t OptionParser::Incremental::errorCount() const
+{
+        return errors;
+}
+
+bool OptionParser::Incremental::schemaValid() const
+{
+        return frozen;
+}
+
+OptionParser::Incremental::Entry OptionParser::Incremental::classify(
+                const std::string& token) const
+{
+        Entry entry;
+
+        if (!frozen) {
+                entry.token.flag = token.size();
+                entry.token.error = schemaError;
+                entry.valid = false;
+        } else {
+                entry.valid = parser.classify(token, entry.token);
+        }
+
+        if (entry.token.valueFirst < token.size()) {
+                entry.value = token.substr(entry.token.valueFirst);
+        }
+
+        return entry;
+}
+
+void OptionParser::addLive(const char& key, bool expectsValue)
+{
+        options.push_back({ key, "", expectsValue, -1, 0, "", true });
+        indexed = false;
+}
+
+bool OptionParser::update(const std::string& command)
+{
+        std::vector<std::string> args = split(command);
+        std::lock_guard<std::mutex> lock(shared->parsing);
+        std::vector<Option> changes;
+
+        if (!shared->schema) {
+                shared->schema = copySchema();
+        }
+
+        if (!shared->schema->parseTokens(args, changes)) {
+                return false;
+        }
+
+        for (const Option& option : changes) {
+                if (!option.live) {
+                        std::cout << program << ": option '-" << option.key
+                                << "' can't be changed at runtime" << std::endl;
+                        return false;
+                }
+        }
+
+        publish(changes);
+        return true;
+}
+
+OptionParser::SnapshotRef OptionParser::live() const
+{
+        return shared->pin(shared->live);
+}
+
+bool OptionParser::Snapshot::has(const char& key) const
+{
+        auto it = std::find_if(options.begin(), options.end(), Compare(key));
+
+        return it != options.end();
+}
+
+const std::string& OptionParser::Snapshot::value(const char& key) const
+{
+        static const std::string empty;
+        auto it = std::find_if(options.rbegin(), options.rend(), Compare(key));
+
+        return it == options.rend() ? empty : (*it).value;
+}
+
+bool OptionParser::watch(const std::string& path)
+{
+        if (shared->watching) {
+                std::cout << program << ": already watching '"
+                        << shared->configPath << "'" << std::endl;
+                return false;
+        }
+
+        // The watcher stopped on an error, it can be started again
+        if (shared->watcher.joinable()) {
+                shared->watcher.join();
+        }
+
+        {
+                std::lock_guard<std::mutex> lock(shared->parsing);
+                if (!shared->schema) {
+                        shared->schema = copySchema();
+                }
+        }
+
+        shared->configPath = path;
+
+        if (!shared->reload()) {
+                return false;
+        }
+
+#if defined(__linux__)
+        // Editors often replace the file, so the directory gets watched
+        std::string::size_type slash = path.rfind('/');
+        std::string directory = slash == std::string::npos
+                ? "." : path.substr(0, std::max<std::string::size_type>(slash, 1));
+
+        // A previous call may have failed after opening them
+        if (shared->watchFd >= 0) {
+                close(shared->watchFd);
+        }
+
+        if (shared->stopFd >= 0) {
+                close(shared->stopFd);
+        }
+
+        shared->watchFd = inotify_init1(IN_CLOEXEC);
+        shared->stopFd = eventfd(0, EFD_CLOEXEC);
+
+        if (shared->watchFd < 0 || shared->stopFd < 0
+                        || inotify_add_watch(shared->watchFd, directory.c_str(),
+                                IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+                std::cout << program << ": can't watch '" << path << "'"
+                        << std::endl;
+                return false;
+        }
+
+        shared->watching = true;
+        shared->watcher = std::thread(&Shared::watchLoop, shared.operator->());
+        return true;
+#else
+        return false;
+#endif
+}
+
+OptionParser::SnapshotRef OptionParser::config() const
+{
+        return shared->pin(shared->config);
+}
+
+OptionParser::SnapshotRef::SnapshotRef(const Snapshot* snapshot,
+                std::atomic<std::uint64_t>* reader)
+        : snapshot(snapshot), reader(reader)
+{
+}
+
+OptionParser::SnapshotRef::SnapshotRef(SnapshotRef&& other) noexcept
+        : snapshot(other.snapshot), reader(other.reader)
+{
+        other.reader = nullptr;
+}
+
+OptionParser::SnapshotRef& OptionParser::SnapshotRef::operator=(
+                SnapshotRef&& other) noexcept
+{
+        if (this != &other) {
+                if (reader) {
+                        reader->store(0, std::memory_order_release);
+                }
+
+                snapshot = other.snapshot;
+                reader = other.reader;
+                other.reader = nullptr;
+        }
+
+        return *this;
+}
+
+OptionParser::SnapshotRef::~SnapshotRef()
+{
+        // Orders the reads of the snapshot before a writer frees it
+        if (reader) {
+                reader->store(0, std::memory_order_release);
+        }
+}
+
+const OptionParser::Snapshot& OptionParser::SnapshotRef::operator*() const
+{
+        return *snapshot;
+}
+
+const OptionParser::Snapshot* OptionParser::SnapshotRef::operator->() const
+{
+        return snapshot;
+}
+
+OptionParser::SnapshotRef OptionParser::Shared::pin(
+                const std::atomic<const Snapshot*>& slot)
+{
+        static const Snapshot empty;
+        thread_local std::size_t hint = std::hash<std::thread::id>()(
+                        std::this_thread::get_id());
+
+        for (std::size_t i = 0; ; ++i) {
+                if (i > 0 && i % readerSlots == 0) {
+                        std::this_thread::yield();
+                }
+
+                std::size_t index = (hint + i) % readerSlots;
+                std::uint64_t unused = 0;
+
+                // A stale epoch only keeps snapshots longer. Marking the slot
+                // and loading the pointer are sequentially consistent, so a
+                // writer that doesn't see the mark replaced the pointer before
+                // it is loaded.
+                if (readers[index].epoch.compare_exchange_strong(unused,
+                                        epoch.load())) {
+                        const Snapshot* current = slot.load();
+
+                        hint = index;
+                        return SnapshotRef(current ? current : &empty,
+                                        &readers[index].epoch);
+                }
+        }
+}
+
+void OptionParser::Shared::replace(std::atomic<const Snapshot*>& slot,
+                const Snapshot* next)
+{
+        const Snapshot* previous = slot.exchange(next);
+
+        if (previous) {
+                retired.emplace_back(epoch.fetch_add(1), previous);
+        }
+
+        std::uint64_t oldest = UINT64_MAX;
+
+        for (const ReaderSlot& reader : readers) {
+                std::uint64_t entered = reader.epoch.load();
+                oldest = entered != 0 ? std::min(oldest, entered) : oldest;
+        }
+
+        // Readers that entered after a snapshot was retired can't see it
+        auto kept = std::partition(retired.begin(), retired.end(),
+                        [oldest](const std::pair<std::uint64_t, const Snapshot*>& entry) {
+                                return entry.first >= oldest;
+                        });
+
+        for (auto it = kept; it != retired.end(); ++it) {
+                delete it->second;
+        }
+
+        retired.erase(kept, retired.end());
+}
+
+OptionParser::SharedState::SharedState()
+        : state(new Shared())
+{
+}
+
+OptionParser::SharedState::SharedState(const SharedState&)
+        : state(new Shared())
+{
+}
+
+OptionParser::SharedState& OptionParser::SharedState::operator=(
+                const SharedState&)
+{
+        state.reset(new Shared());
+        return *this;
+}
+
+OptionParser::Shared* OptionParser::SharedState::operator->() const
+{
+        return state.get();
+}
+
+std::unique_ptr<OptionParser> OptionParser::copySchema() const
+{
+        std::unique_ptr<OptionParser> schema(new OptionParser(*this));
+
+        schema->parsed.clear();
+        schema->byKey.clear();
+        schema->scopes.clear();
+        schema->responseFiles.clear();
+        schema->cachePath.clear();
+
+        return schema;
+}
+
+OptionParser::Shared::~Shared()
+{
+#if defined(__linux__)
+        if (watcher.joinable()) {
+                std::uint64_t one = 1;
+                ssize_t written = write(stopFd, &one, sizeof(one));
+                (void) written;
+                watcher.join();
+        }
+
+        if (watchFd >= 0) {
+                close(watchFd);
+        }
+
+        if (stopFd >= 0) {
+                close(stopFd);
+        }
+#endif
+
+        delete live.load();
+        delete config.load();
+
+        for (const auto& entry : retired) {
+                delete entry.second;
+        }
+}
+
+OptionParser::Values OptionParser::values(const char& key) const
+{
+        unsigned char k = static_cast<unsigned char>(key);
+        Values result;
+
+        result.parsed = &parsed;
+        result.first = byKey.data() + offsets[k];
+        result.last = byKey.data() + offsets[k + 1];
+
+        return result;
+}
+
+OptionParser::Values OptionParser::values(char32_t key) const
+{
+        char k = keyOf(key);
+        Values result = values(k);
+
+        if (k == '\0') {
+                result.last = result.first;
+        }
+
+        return result;
+}
+
+std::size_t OptionParser::Values::size() const
+{
+        return last - first;
+}
+
+const std::string& OptionParser::Values::operator[](std::size_t i) const
+{
+        return (*parsed)[first[i]].value;
+}
+
+OptionParser::Values::Iterator OptionParser::Values::begin() const
+{
+        Iterator it;
+        it.values = this;
+        it.i = 0;
+
+        return it;
+}
+
+OptionParser::Values::Iterator OptionParser::Values::end() const
+{
+        Iterator it;
+        it.values = this;
+        it.i = size();
+
+        return it;
+}
+
+const std::string& OptionParser::Values::Iterator::operator*() const
+{
+        return (*values)[i];
+}
+
+OptionParser::Values::Iterator& OptionParser::Values::Iterator::operator++()
+{
+        ++i;
+        return *this;
+}
+
+bool OptionParser::Values::Iterator::operator!=(const Iterator& other) const
+{
+        return i != other.i;
+}
+
+int OptionParser::indexOf(const char& key)
+{
+        auto it = next(key);
+
+        return it == parsed.end() ? 0 : (*it).index;
+}
+
+const std::string& OptionParser::valueAt(const char& key, int index)
+{
+        return scopedValue(scope(key), index);
+}
+
+bool OptionParser::validate(const char& inputKey, const std::vector<char>& keys,
+                const Validator& validator, unsigned threads)
+{
+        // The tables are built up front, so the threads only read them
+        for (char key : keys) {
+                scope(key);
+        }
+
+        std::vector<Group> groups;
+        for (const Option& option : parsed) {
+                if (option.key == inputKey) {
+                        Group group;
+                        group.parser = this;
+                        group.ordinal = groups.size();
+                        group.option = &option;
+                        groups.push_back(group);
+                }
+        }
+
+        std::vector<std::string> messages(groups.size());
+        std::unique_ptr<bool[]> valid(new bool[groups.size()]);
+        std::atomic<std::size_t> claimed { 0 };
+        const std::size_t batch = 64;
+
+        auto work = [&]() {
+                for (std::size_t first = claimed.fetch_add(batch);
+                                first < groups.size();
+                                first = claimed.fetch_add(batch)) {
+                        std::size_t last = std::min(first + batch, groups.size());
+
+                        for (std::size_t i = first; i < last; ++i) {
+                                valid[i] = validator(groups[i], messages[i]);
+                        }
+                }
+        };
+
+        if (threads == 0) {
+                threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+
+        std::size_t batches = (groups.size() + batch - 1) / batch;
+        std::vector<std::thread> pool;
+
+        for (std::size_t i = 1; i < std::min<std::size_t>(threads, batches); ++i) {
+                pool.emplace_back(work);
+        }
+
+        work();
+        for (std::thread& thread : pool) {
+                thread.join();
+        }
+
+        errors = 0;
+
+        for (std::size_t i = 0; i < groups.size(); ++i) {
+                if (!valid[i]) {
+                        std::cout << program << ": invalid input '"
+                                << groups[i].input() << "'";
+                        if (!messages[i].empty()) {
+                                std::cout << ": " << messages[i];
+                        }
+                        std::cout << std::endl;
+
+                        if (fail(Error::InvalidInput, groups[i].index(), inputKey)) {
+                                return false;
+                        }
+                }
+        }
+
+        return errors == 0;
+}
+
+std::size_t OptionParser::Group::number() const
+{
+        return ordinal;
+}
+
+int OptionParser::Group::index() const
+{
+        return option->index;
+}
+
+const std::string& OptionParser::Group::input() const
+{
+        return option->value;
+}
+
+const std::string& OptionParser::Group::value(const char& key) const
+{
+        static const std::string empty;
+        const std::vector<int>* last = parser->findScope(key);
+
+        return last ? parser->scopedValue(*last, option->index) : empty;
+}
+
+std::uint64_t OptionParser::fingerprint() const
+{
+        Hasher hasher;
+        auto update = [&hasher](const Option& option) {
+                char key = option.codePoint ? '\0' : option.key;
+
+                hasher.update(&key, sizeof(key));
+                hasher.update(&option.codePoint, sizeof(option.codePoint));
+                hasher.update(option.name);
+                hasher.update(option.value);
+        };
+
+        // The index already orders the options by key and then by position,
+        // only the long options without a key need to be ordered by name
+        std::vector<std::uint32_t> unkeyed(byKey.data() + offsets[0],
+                        byKey.data() + offsets[1]);
+        std::stable_sort(unkeyed.begin(), unkeyed.end(),
+                        [this](std::uint32_t a, std::uint32_t b) {
+                                return parsed[a].name < parsed[b].name;
+                        });
+
+        for (std::uint32_t i : unkeyed) {
+                update(parsed[i]);
+        }
+
+        for (std::size_t i = offsets[1]; i < byKey.size(); ++i) {
+                update(parsed[byKey[i]]);
+        }
+
+        return hasher.digest();
+}
+
+OptionParser::Override::Override(const char& key,
+                std::vector<std::string> values)
+        : key(key), values(std::move(values))
+{
+}
+
+OptionParser::Override::Override(char32_t key, std::vector<std::string> values)
+        : key(key < 0x80 ? static_cast<char>(key) : '\0'),
+          codePoint(key < 0x80 ? 0 : key), values(std::move(values))
+{
+}
+
+OptionParser::Override::Override(std::string name,
+                std::vector<std::string> values)
+        : name(std::move(name)), values(std::move(values))
+{
+}
+
+OptionParser::Argv OptionParser::toArgv(const std::vector<Override>& overrides) const
+{
+        std::vector<const Option*> targets;
+
+        for (const Override& replaced : overrides) {
+                auto it = std::find_if(options.begin(), options.end(),
+                                [&replaced](const Option& option) {
+                                        if (!replaced.name.empty()) {
+                                                return option.name == replaced.name;
+                                        }
+
+                                        return replaced.codePoint != 0
+                                                ? option.codePoint == replaced.codePoint
+                                                : replaced.key != '\0'
+                                                        && option.codePoint == 0
+                                                        && option.key == replaced.key;
+                                });
+
+                if (it == options.end()) {
+                        char text[4];
+                        std::string flag = !replaced.name.empty()
+                                ? "--" + replaced.name
+                                : replaced.codePoint != 0
+                                        ? "-" + std::string(text, encode(replaced.codePoint, text))
+                                        : std::string("-") + replaced.key;
+
+                        out() << program << ": can't override unknown option '"
+                                << flag << "'" << std::endl;
+                        return Argv();
+                }
+
+                // The values are checked like 'classify' checks them
+                for (const std::string& value : replaced.values) {
+                        Token token;
+                        token.slot = static_cast<int>(it - options.begin());
+
+                        if (it->expectsValue && value.empty()) {
+                                token.error = Error::MissingValue;
+                        } else if (!it->expectsValue && !value.empty()) {
+                                token.error = Error::UnexpectedValue;
+                        } else if (it->choices >= 0 && findChoice(choiceSets[it->choices],
+                                                value.data(), value.size()) < 0) {
+                                token.error = Error::InvalidChoice;
+                        } else if (it->pattern && !it->pattern->matches(value.data(),
+                                                value.data() + value.size())) {
+                                token.error = Error::InvalidValue;
+                        } else {
+                                continue;
+                        }
+
+                        char text[4];
+                        std::string flag = it->codePoint != 0
+                                ? "-" + std::string(text, encode(it->codePoint, text))
+                                : it->key != '\0'
+                                        ? std::string("-") + it->key
+                                        : "--" + it->name;
+
+                        token.flag = flag.size();
+                        token.valueFirst = flag.size();
+                        report(flag + value, token);
+                        return Argv();
+                }
+
+                targets.push_back(&*it);
+        }
+
+        // Walks the options that end up in the command line, first the ones
+        // that aren't overridden and then the overrides
+        auto visit = [this, &overrides, &targets](auto&& emit) {
+                for (const Option& option : parsed) {
+                        if (!option.popped && std::none_of(targets.begin(), targets.end(),
+                                        [&option](const Option* target) {
+                                                return target->key == option.key
+                                                        && target->codePoint == option.codePoint
+                                                        && target->name == option.name;
+                                        })) {
+                                // Only '--name=' can carry an empty value
+                                bool isLong = option.expectsValue
+                                        && option.value.empty();
+
+                                emit(isLong ? '\0' : option.key,
+                                                isLong ? 0 : option.codePoint,
+                                                option.name, option.expectsValue,
+                                                option.value);
+                        }
+                }
+
+                for (std::size_t i = 0; i < overrides.size(); ++i) {
+                        for (const std::string& value : overrides[i].values) {
+                                emit(targets[i]->key, targets[i]->codePoint,
+                                                targets[i]->name,
+                                                targets[i]->expectsValue, value);
+                        }
+                }
+        };
+
+        // Count first, so the strings need a single allocation
+        std::size_t size = program.size() + 1;
+        int count = 1;
+
+        visit([&size, &count](char key, char32_t codePoint,
+                                const std::string& name, bool expectsValue,
+                                const std::string& value) {
+                char text[4];
+
+                size += (key != '\0' ? 1 + (codePoint ? encode(codePoint, text) : 1)
+                                : 2 + name.size())
+                        + (key == '\0' && expectsValue ? 1 : 0)
+                        + value.size() + 1;
+                ++count;
+        });
+
+        Argv result;
+        result.count = count;
+        result.strings.reset(new char[size]);
+        result.pointers.reset(new char*[count + 1]);
+
+        char* out = result.strings.get();
+        char** pointer = result.pointers.get();
+        auto append = [&out](const char* text, std::size_t size) {
+                std::memcpy(out, text, size);
+                out += size;
+        };
+
+        *pointer++ = out;
+        append(program.c_str(), program.size() + 1);
+
+        visit([&out, &pointer, &append](char key, char32_t codePoint,
+                                const std::string& name, bool expectsValue,
+                                const std::string& value) {
+                *pointer++ = out;
+
+                if (codePoint != 0) {
+                        char text[4];
+                        append("-", 1);
+                        append(text, encode(codePoint, text));
+                } else if (key != '\0') {
+                        const char flag[] = { '-', key };
+                        append(flag, 2);
+                } else {
+                        append("--", 2);
+                        append(name.data(), name.size());
+                        if (expectsValue) {
+                                append("=", 1);
+                        }
+                }
+
+                append(value.c_str(), value.size() + 1);
+        });
+
+        *pointer = nullptr;
+        return result;
+}
+
+bool OptionParser::writeCompletions(const std::string& path)
+{
+        if (!prepare()) {
+                return false;
+        }
+
+        std::vector<std::string> candidates;
+
+        for (const Option& option : options) {
+                std::string flag = option.key != '\0'
+                        ? std::string("-") + option.key : "";
+
+                if (option.codePoint != 0) {
+                        char text[4];
+                        flag = "-" + std::string(text, encode(option.codePoint, text));
+                }
+
+                if (option.choices >= 0) {
+                        for (const std::string& name : choiceSets[option.choices].names) {
+                                candidates.push_back(flag + name);
+                        }
+                } else if (!flag.empty()) {
+                        candidates.push_back(flag);
+                }
+
+                if (!option.name.empty()) {
+                        candidates.push_back("--" + option.name
+                                        + (option.expectsValue ? "=" : ""));
+                }
+        }
+
+        for (const Family& family : families) {
+                for (const Family::Member& member : family.members) {
+                        candidates.push_back(std::string("-") + family.prefix
+                                        + member.name + (member.expectsValue ? "=" : ""));
+                }
+        }
+
+        std::sort(candidates.begin(), candidates.end());
+        candidates.erase(std::unique(candidates.begin(), candidates.end()),
+                        candidates.end());
+
+        // The file holds the number of candidates, their offsets and then the
+        // candidates themselves
+        std::vector<std::uint32_t> offsets { 0 };
+        for (const std::string& candidate : candidates) {
+                offsets.push_back(offsets.back()
+                                + static_cast<std::uint32_t>(candidate.size()));
+        }
+
+        std::uint32_t count = static_cast<std::uint32_t>(candidates.size());
+        std::string bytes(completionMagic, sizeof(completionMagic));
+
+        bytes.append(reinterpret_cast<const char*>(&count), sizeof(count));
+        bytes.append(reinterpret_cast<const char*>(offsets.data()),
+                        offsets.size() * sizeof(std::uint32_t));
+        for (const std::string& candidate : candidates) {
+                bytes.append(candidate);
+        }
+
+        // 'complete' maps the file, truncating it in place could crash it
+        return replaceFile(path, bytes);
+}
+
+std::vector<std::string> OptionParser::complete(const std::string& path,
+                const std::string& partial)
+{
+        std::vector<std::string> candidates;
+
+#if defined(__unix__)
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat info;
+
+        if (fd < 0) {
+                return candidates;
+        }
+
+        std::size_t size = fstat(fd, &info) == 0 ? info.st_size : 0;
+        void* data = size > 0
+                ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+        close(fd);
+
+        if (data == MAP_FAILED) {
+                return candidates;
+        }
+
+        const char* bytes = static_cast<const char*>(data);
+        std::size_t header = sizeof(completionMagic) + sizeof(std::uint32_t);
+        std::uint32_t count = 0;
+
+        if (size >= header && std::memcmp(bytes, completionMagic,
+                                sizeof(completionMagic)) == 0) {
+                std::memcpy(&count, bytes + sizeof(completionMagic), sizeof(count));
+        }
+
+        // The offsets have to fit into the file before they are read
+        std::size_t room = (size - std::min(size, header)) / sizeof(std::uint32_t);
+        std::size_t blob = header + (std::size_t(count) + 1) * sizeof(std::uint32_t);
+        bool valid = count > 0 && count < room;
+        std::size_t blobSize = valid ? size - blob : 0;
+
+        // Offsets are read from the mapping in place, a candidate whose
+        // offsets are out of order or outside of the file marks it damaged
+        auto offset = [bytes, header](std::uint32_t i) {
+                std::uint32_t value;
+                std::memcpy(&value, bytes + header + i * sizeof(value),
+                                sizeof(value));
+                return value;
+        };
+        auto candidate = [&](std::uint32_t i) {
+                std::uint32_t first = offset(i);
+                std::uint32_t last = offset(i + 1);
+
+                if (first > last || last > blobSize) {
+                        valid = false;
+                        return std::string_view();
+                }
+
+                return std::string_view(bytes + blob + first, last - first);
+        };
+
+        // Binary search for the first candidate not less than 'partial'
+        std::uint32_t first = 0;
+        std::uint32_t last = valid ? count : 0;
+
+        while (first < last) {
+                std::uint32_t middle = first + (last - first) / 2;
+                if (candidate(middle) < partial) {
+                        first = middle + 1;
+                } else {
+                        last = middle;
+                }
+        }
+
+        for (; valid && first < count; ++first) {
+                std::string_view next = candidate(first);
+                if (!valid || next.compare(0, partial.size(), partial) != 0) {
+                        break;
+                }
+                candidates.emplace_back(next);
+        }
+
+        if (!valid) {
+                candidates.clear();
+        }
+
+        munmap(data, size);
+#endif
+
+        return candidates;
+}
+
+void OptionParser::useCache(const std::string& path, const char& inputKey)
+{
+        cachePath = path;
+        cacheInputKey = inputKey;
+}
+
+bool OptionParser::cached() const
+{
+        return fromCache;
+}
+
+std::uint64_t OptionParser::cacheFingerprint(int argc, char* argv[])
+{
+        Hasher hasher;
+
+        for (const Option& option : options) {
+                hasher.update(&option.key, sizeof(option.key));
+                hasher.update(&option.codePoint, sizeof(option.codePoint));
+                hasher.update(option.name);
+                hasher.update(&option.expectsValue, sizeof(option.expectsValue));
+                hasher.update(&option.live, sizeof(option.live));
+
+                if (option.choices >= 0) {
+                        const ChoiceSet& set = choiceSets[option.choices];
+
+                        for (std::size_t i = 0; i < set.names.size(); ++i) {
+                                hasher.update(set.names[i]);
+                                hasher.update(&set.values[i], sizeof(set.values[i]));
+                        }
+                }
+
+                if (option.pattern) {
+                        hasher.update(option.pattern->next,
+                                        sizeof(option.pattern->next));
+                        hasher.update(option.pattern->accepting,
+                                        sizeof(option.pattern->accepting));
+                }
+        }
+
+        for (const Family& family : families) {
+                hasher.update(&family.prefix, sizeof(family.prefix));
+
+                for (const Family::Member& member : family.members) {
+                        hasher.update(member.name);
+                        hasher.update(&member.id, sizeof(member.id));
+                        hasher.update(&member.expectsValue,
+                                        sizeof(member.expectsValue));
+                }
+        }
+
+        const std::size_t bounds[] = {
+                limits.maxTokens, limits.maxValueBytes,
+                limits.maxOccurrences, limits.maxDepth
+        };
+        hasher.update(bounds, sizeof(bounds));
+
+        // They change which command lines 'parse' accepts
+        const bool modes[] = { limits.responseFiles, collect, lenient };
+        hasher.update(modes, sizeof(modes));
+
+#if defined(__unix__)
+        // Relative paths in the arguments depend on it
+        char directory[4096];
+        hasher.update(getcwd(directory, sizeof(directory)) ? directory : "");
+#endif
+
+        for (int i = 0; i < argc; ++i) {
+                hasher.update(argv[i]);
+        }
+
+        return hasher.digest();
+}
+
+bool OptionParser::stamp(const std::string& path, std::int64_t& mtime,
+                std::int64_t& size)
+{
+#if defined(__unix__)
+        struct stat info;
+
+        if (stat(path.c_str(), &info) != 0) {
+                return false;
+        }
+
+#if defined(__APPLE__)
+        mtime = info.st_mtimespec.tv_sec * 1000000000ll + info.st_mtimespec.tv_nsec;
+#else
+        mtime = info.st_mtim.tv_sec * 1000000000ll + info.st_mtim.tv_nsec;
+#endif
+        size = info.st_size;
+
+        return true;
+#else
+        (void) path;
+        (void) mtime;
+        (void) size;
+
+        return false;
+#endif
+}
+
+bool OptionParser::loadCache(int argc, char* argv[])
+{
+#if defined(__unix__)
+        // Family handlers only run while parsing
+        if (!families.empty() || !prepare()) {
+                return false;
+        }
+
+        cacheKey = cacheFingerprint(argc, argv);
+
+        int fd = open(cachePath.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat info;
+
+        if (fd < 0) {
+                return false;
+        }
+
+        std::size_t size = fstat(fd, &info) == 0 ? info.st_size : 0;
+        void* data = size > 0
+                ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+        close(fd);
+
+        if (data == MAP_FAILED) {
+                return false;
+        }
+
+        const char* first = static_cast<const char*>(data);
+        const char* last = first + size;
+        bool valid = true;
+
+        // Every read checks the bounds, a damaged file is a miss
+        auto read = [&first, last, &valid](void* value, std::size_t count) {
+                valid = valid && std::size_t(last - first) >= count;
+                if (valid) {
+                        std::memcpy(value, first, count);
+                        first += count;
+                }
+        };
+        auto readString = [&first, last, &valid, &read](std::string& text) {
+                std::uint32_t length = 0;
+                read(&length, sizeof(length));
+                valid = valid && std::size_t(last - first) >= length;
+                if (valid) {
+                        text.assign(first, length);
+                        first += length;
+                }
+        };
+
+        char magic[sizeof(cacheMagic)] = {};
+        std::uint64_t key = 0;
+        std::uint32_t inputCount = 0;
+        std::uint32_t optionCount = 0;
+
+        read(magic, sizeof(magic));
+        read(&key, sizeof(key));
+        read(&inputCount, sizeof(inputCount));
+        read(&optionCount, sizeof(optionCount));
+
+        valid = valid && std::memcmp(magic, cacheMagic, sizeof(magic)) == 0
+                && key == cacheKey;
+
+        std::string path;
+
+        for (std::uint32_t i = 0; valid && i < inputCount; ++i) {
+                std::int64_t recorded[2];
+                std::int64_t current[2];
+
+                readString(path);
+                read(recorded, sizeof(recorded));
+
+                valid = valid && stamp(path, current[0], current[1])
+                        && current[0] == recorded[0] && current[1] == recorded[1];
+        }
+
+        std::vector<Option> result;
+        result.reserve(valid ? std::min<std::size_t>(optionCount, size) : 0);
+
+        // Without response files every option comes from its own argument
+        int maxIndex = limits.responseFiles
+                ? static_cast<int>(std::min<std::size_t>(limits.maxTokens, INT_MAX))
+                : argc - 1;
+        int previous = 0;
+
+        for (std::uint32_t i = 0; valid && i < optionCount; ++i) {
+                Option option { '\0', "", false };
+                std::uint8_t flags = 0;
+
+                read(&option.key, sizeof(option.key));
+                read(&flags, sizeof(flags));
+                read(&option.choices, sizeof(option.choices));
+                read(&option.choice, sizeof(option.choice));
+                read(&option.index, sizeof(option.index));
+                read(&option.codePoint, sizeof(option.codePoint));
+                readString(option.name);
+                readString(option.value);
+
+                option.expectsValue = flags & 1;
+                option.live = flags & 2;
+
+                // The file may be damaged, so every option has to be one the
+                // schema has and a value 'classify' accepts
+                valid = valid && option.index > previous && option.index <= maxIndex
+                        && acceptsCached(option);
+                previous = option.index;
+
+                if (valid) {
+                        result.push_back(std::move(option));
+                }
+        }
+
+        munmap(data, size);
+
+        if (valid) {
+                parsed = std::move(result);
+        }
+
+        return valid;
+#else
+        (void) argc;
+        (void) argv;
+
+        return false;
+#endif
+}
+
+bool OptionParser::acceptsCached(Option& option) const
+{
+        unsigned char k = static_cast<unsigned char>(option.key);
+        int slot = option.codePoint != 0 ? findCodePoint(option.codePoint)
+                : option.key != '\0' ? keySlots[k]
+                : nameIndex.find(option.name.data(), option.name.size(), false);
+
+        if (slot < 0) {
+                return false;
+        }
+
+        const Option& schema = options[slot];
+        const std::string& value = option.value;
+
+        if (schema.key != option.key || schema.codePoint != option.codePoint
+                        || schema.name != option.name
+                        || schema.expectsValue != option.expectsValue
+                        || schema.live != option.live
+                        || schema.choices != option.choices
+                        || (!schema.expectsValue && !value.empty())) {
+                return false;
+        }
+
+        if (schema.choices >= 0) {
+                const ChoiceSet& set = choiceSets[schema.choices];
+                int choice = findChoice(set, value.data(), value.size());
+
+                if (choice < 0 || set.values[choice] != option.choice) {
+                        return false;
+                }
+        }
+
+        if (schema.pattern && !schema.pattern->matches(value.data(),
+                                value.data() + value.size())) {
+                return false;
+        }
+
+        option.pattern = schema.pattern;
+        return true;
+}
+
+bool OptionParser::storeCache()
+{
+        if (fromCache) {
+                return true;
+        }
+
+        if (cachePath.empty() || cacheKey == 0 || !families.empty()) {
+                return false;
+        }
+
+        std::vector<std::string> inputs = responseFiles;
+        if (cacheInputKey != '\0') {
+                for (const std::string& value : values(cacheInputKey)) {
+                        inputs.push_back(value);
+                }
+        }
+
+        std::string bytes(cacheMagic, sizeof(cacheMagic));
+        auto write = [&bytes](const void* value, std::size_t count) {
+                bytes.append(static_cast<const char*>(value), count);
+        };
+        auto writeString = [&write](const std::string& text) {
+                std::uint32_t length = static_cast<std::uint32_t>(text.size());
+                write(&length, sizeof(length));
+                write(text.data(), text.size());
+        };
+
+        std::uint32_t inputCount = static_cast<std::uint32_t>(inputs.size());
+        std::uint32_t optionCount = static_cast<std::uint32_t>(parsed.size());
+
+        write(&cacheKey, sizeof(cacheKey));
+        write(&inputCount, sizeof(inputCount));
+        write(&optionCount, sizeof(optionCount));
+
+        for (const std::string& input : inputs) {
+                std::int64_t recorded[2];
+
+                if (!stamp(input, recorded[0], recorded[1])) {
                         return false;
                 }
 
-                Option option = *optionIt;
+                writeString(input);
+                write(recorded, sizeof(recorded));
+        }
+
+        for (const Option& option : parsed) {
+                std::uint8_t flags = (option.expectsValue ? 1 : 0)
+                        | (option.live ? 2 : 0);
+
+                write(&option.key, sizeof(option.key));
+                write(&flags, sizeof(flags));
+                write(&option.choices, sizeof(option.choices));
+                write(&option.choice, sizeof(option.choice));
+                write(&option.index, sizeof(option.index));
+                write(&option.codePoint, sizeof(option.codePoint));
+                writeString(option.name);
+                writeString(option.value);
+        }
+
+        return replaceFile(cachePath, bytes);
+}
+
+bool OptionParser::replaceFile(const std::string& path, const std::string& bytes)
+{
+#if defined(__unix__)
+        // Processes that write at the same time don't share the temporary
+        // file, the last rename wins
+        std::string temporary = path + ".XXXXXX";
+        int fd = mkstemp(&temporary[0]);
+
+        if (fd < 0) {
+                return false;
+        }
+
+        const char* first = bytes.data();
+        const char* last = first + bytes.size();
+
+        while (first < last) {
+                ssize_t count = ::write(fd, first, last - first);
+
+                if (count < 0 && errno == EINTR) {
+                        continue;
+                }
+
+                if (count <= 0) {
+                        break;
+                }
+
+                first += count;
+        }
+
+        bool written = close(fd) == 0 && first == last
+                && std::rename(temporary.c_str(), path.c_str()) == 0;
+
+        if (!written) {
+                unlink(temporary.c_str());
+        }
+
+        return written;
+#else
+        (void) path;
+        (void) bytes;
+
+        return false;
+#endif
+}
+
+OptionParser::Hasher::Hasher(std::uint64_t seed)
+        : seed(seed)
+{
+        lanes[0] = seed + 0x9e3779b185ebca87ull + 0xc2b2ae3d27d4eb4full;
+        lanes[1] = seed + 0xc2b2ae3d27d4eb4full;
+        lanes[2] = seed;
+        lanes[3] = seed - 0x9e3779b185ebca87ull;
+}
+
+std::uint64_t OptionParser::Hasher::round(std::uint64_t lane,
+                std::uint64_t input)
+{
+        lane += input * 0xc2b2ae3d27d4eb4full;
+        lane = (lane << 31) | (lane >> 33);
+        return lane * 0x9e3779b185ebca87ull;
+}
+
+std::uint64_t OptionParser::Hasher::read64(const unsigned char* bytes)
+{
+        std::uint64_t value;
+        std::memcpy(&value, bytes, sizeof(value));
+        return value;
+}
+
+void OptionParser::Hasher::update(const void* data, std::size_t size)
+{
+        const unsigned char* first = static_cast<const unsigned char*>(data);
+        const unsigned char* last = first + size;
+        total += size;
+
+        if (buffered + size < sizeof(buffer)) {
+                std::memcpy(buffer + buffered, first, size);
+                buffered += size;
+                return;
+        }
+
+        if (buffered > 0) {
+                std::size_t fill = sizeof(buffer) - buffered;
+                std::memcpy(buffer + buffered, first, fill);
+                first += fill;
+
+                for (int i = 0; i < 4; ++i) {
+                        lanes[i] = round(lanes[i], read64(buffer + 8 * i));
+                }
+                buffered = 0;
+        }
+
+        // The four lanes are independent, so this runs at memory speed
+        for (; last - first >= 32; first += 32) {
+                lanes[0] = round(lanes[0], read64(first));
+                lanes[1] = round(lanes[1], read64(first + 8));
+                lanes[2] = round(lanes[2], read64(first + 16));
+                lanes[3] = round(lanes[3], read64(first + 24));
+        }
+
+        std::memcpy(buffer, first, last - first);
+        buffered = last - first;
+}
+
+void OptionParser::Hasher::update(const std::string& text)
+{
+        std::uint64_t size = text.size();
+
+        update(&size, sizeof(size));
+        update(text.data(), text.size());
+}
+
+std::uint64_t OptionParser::Hasher::digest() const
+{
+        const std::uint64_t prime1 = 0x9e3779b185ebca87ull;
+        const std::uint64_t prime2 = 0xc2b2ae3d27d4eb4full;
+        const std::uint64_t prime3 = 0x165667b19e3779f9ull;
+        const std::uint64_t prime4 = 0x85ebca77c2b2ae63ull;
+        const std::uint64_t prime5 = 0x27d4eb2f165667c5ull;
+
+        auto rotate = [](std::uint64_t value, int bits) {
+                return (value << bits) | (value >> (64 - bits));
+        };
+
+        std::uint64_t h;
+
+        if (total >= 32) {
+                h = rotate(lanes[0], 1) + rotate(lanes[1], 7)
+                        + rotate(lanes[2], 12) + rotate(lanes[3], 18);
+
+                for (int i = 0; i < 4; ++i) {
+                        h = (h ^ round(0, lanes[i])) * prime1 + prime4;
+                }
+        } else {
+                h = seed + prime5;
+        }
+
+        h += total;
+
+        const unsigned char* first = buffer;
+        const unsigned char* last = buffer + buffered;
+
+        for (; last - first >= 8; first += 8) {
+                h ^= round(0, read64(first));
+                h = rotate(h, 27) * prime1 + prime4;
+        }
+
+        if (last - first >= 4) {
+                std::uint32_t value;
+                std::memcpy(&value, first, sizeof(value));
+                h ^= value * prime1;
+                h = rotate(h, 23) * prime2 + prime3;
+                first += 4;
+        }
+
+        for (; first < last; ++first) {
+                h ^= *first * prime5;
+                h = rotate(h, 11) * prime1;
+        }
+
+        h ^= h >> 33;
+        h *= prime2;
+        h ^= h >> 29;
+        h *= prime3;
+        h ^= h >> 32;
+
+        return h;
+}
+
+int OptionParser::Argv::argc() const
+{
+        return count;
+}
+
+char** OptionParser::Argv::argv() const
+{
+        return pointers.get();
+}
+
+const OptionParser& OptionParser::process()
+{
+        static std::once_flag once;
+        static OptionParser parser;
+        static std::unique_ptr<char[]> arena;
+
+        std::call_once(once, []() {
+                parser.lenient = true;
+                parser.addRegistered();
+
+                std::size_t capacity = 4096;
+                std::size_t size = 0;
+                arena.reset(new char[capacity]);
+
+#if defined(__linux__)
+                int fd = open("/proc/self/cmdline", O_RDONLY | O_CLOEXEC);
+
+                // Usually a single read, the buffer only grows for long
+                // command lines
+                for (ssize_t count = 1; fd >= 0 && count > 0; size += count) {
+                        if (size == capacity) {
+                                std::unique_ptr<char[]> larger(new char[capacity * 2]);
+                                std::memcpy(larger.get(), arena.get(), size);
+                                arena = std::move(larger);
+                                capacity *= 2;
+                        }
+
+                        count = read(fd, arena.get() + size, capacity - size);
+                        count = count < 0 ? 0 : count;
+                }
+
+                if (fd >= 0) {
+                        close(fd);
+                }
+#endif
+
+                std::vector<char*> argv;
+                char* first = arena.get();
+                char* last = first + size;
+
+                while (first < last) {
+                        char* end = static_cast<char*>(std::memchr(first, '\0',
+                                                last - first));
+                        end = end ? end : last;
+                        *end = '\0';
+                        argv.push_back(first);
+                        first = end + 1;
+                }
+
+                static char empty[] = "";
+                if (argv.empty()) {
+                        argv.push_back(empty);
+                }
+
+                int argc = static_cast<int>(argv.size());
+                argv.push_back(nullptr);
+                parser.parse(argc, argv.data());
+        });
+
+        return parser;
+}
+
+void OptionParser::setLimits(const Limits& limits)
+{
+        this->limits = limits;
+}
+
+void OptionParser::collectErrors(bool collect)
+{
+        this->collect = collect;
+}
+
+const OptionParser::Diagnostic* OptionParser::diagnostics() const
+{
+        return diagnosticBuffer.data();
+}
+
+std::size_t OptionParser::diagnosticCount() const
+{
+        return std::min(errors, maxDiagnostics);
+}
+
+std::size_t OptionParser::errorCount() const
+{
+        return errors;
+}
+
+void OptionParser::add(const char& key, bool expectsValue)
+{
+        options.push_back({ key, "", expectsValue });
+        indexed = false;
+}
+
+void OptionParser::add(char32_t key, bool expectsValue)
+{
+        if (key < 0x80) {
+                add(static_cast<char>(key), expectsValue);
+                return;
+        }
+
+        Option option { '\0', "", expectsValue };
+        option.codePoint = key;
+        options.push_back(option);
+        indexed = false;
+}
+
+void OptionParser::add(const char& key, const Pattern& pattern)
+{
+        Option option { key, "", true };
+        option.pattern = &pattern;
+        options.push_back(option);
+        indexed = false;
+}
+
+void OptionParser::add(const std::string& name, bool expectsValue)
+{
+        options.push_back({ '\0', "", expectsValue, -1, 0, name });
+        indexed = false;
+}
+
+void OptionParser::addChoices(const char& key, std::vector<std::string> names,
+                std::vector<int> values)
+{
+        ChoiceSet set { std::move(names), std::move(values), {}, 0 };
+
+        // Search for a seed that maps every name to its own slot, growing the
+        // table whenever a few seeds in a row fail
+        std::size_t size = 4;
+        while (size < 2 * set.names.size()) {
+                size *= 2;
+        }
+
+        for (bool collision = true; collision; ) {
+                set.seed = set.seed + 1;
+                if (set.seed % 16 == 0) {
+                        size *= 2;
+                }
+
+                set.slots.assign(size, -1);
+                collision = false;
+
+                for (std::size_t i = 0; i < set.names.size() && !collision; ++i) {
+                        const std::string& name = set.names[i];
+                        int& slot = set.slots[hash(name.data(), name.size(),
+                                        set.seed) & (size - 1)];
+
+                        if (slot >= 0 && set.names[slot] != name) {
+                                collision = true;
+                        } else if (slot < 0) {
+                                slot = static_cast<int>(i);
+                        }
+                }
+        }
+
+        options.push_back({ key, "", true, static_cast<int>(choiceSets.size()) });
+        choiceSets.push_back(std::move(set));
+        indexed = false;
+}
+
+int OptionParser::findChoice(const ChoiceSet& set, const char* name,
+                std::size_t size)
+{
+        int slot = set.slots[hash(name, size, set.seed) & (set.slots.size() - 1)];
+
+        if (slot < 0 || set.names[slot].size() != size
+                        || std::memcmp(set.names[slot].data(), name, size) != 0) {
+                return -1;
+        }
+
+        return slot;
+}
+
+std::uint32_t OptionParser::hash(const char* name, std::size_t size,
+                std::uint32_t seed)
+{
+        std::uint32_t h = 2166136261u ^ (seed * 0x9e3779b9u);
+
+        for (std::size_t i = 0; i < size; ++i) {
+                h = (h ^ static_cast<unsigned char>(name[i])) * 16777619u;
+        }
+
+        return h ^ (h >> 15);
+}
+
+void OptionParser::addFamily(const char& prefix, FamilyHandler handler)
+{
+        families.push_back({ prefix, std::move(handler), {}, {} });
+        indexed = false;
+}
+
+void OptionParser::addMember(const char& prefix, const std::string& name,
+                int member, bool expectsValue)
+{
+        auto it = std::find_if(families.begin(), families.end(),
+                        [prefix](const Family& family) {
+                                return family.prefix == prefix;
+                        });
+
+        if (it != families.end()) {
+                (*it).members.push_back({ name, member, expectsValue });
+                indexed = false;
+        }
+}
+
+bool OptionParser::has(const char& key)
+{
+        auto it = next(key);
+
+        return it != parsed.end();
+}
+
+bool OptionParser::has(char32_t key)
+{
+        char k = keyOf(key);
+
+        return k != '\0' && has(k);
+}
+
+std::string OptionParser::popValue(char32_t key)
+{
+        char k = keyOf(key);
+
+        return k != '\0' ? popValue(k) : "";
+}
+
+std::string OptionParser::popValue(const char& key)
+{
+        auto it = next(key);
+
+        if (it == parsed.end()) {
+                return "";
+        }
+
+        (*it).popped = true;
+        return (*it).value;
+}
+
+bool OptionParser::has(const std::string& name)
+{
+        auto it = next(name);
+
+        return it != parsed.end();
+}
+
+std::string OptionParser::popValue(const std::string& name)
+{
+        auto it = next(name);
+
+        if (it == parsed.end()) {
+                return "";
+        }
+
+        std::string value = (*it).value;
+        (*it).popped = true;
+
+        return value;
+}
+
+std::vector<OptionParser::Option>::iterator OptionParser::next(const char& key)
+{
+        unsigned char k = static_cast<unsigned char>(key);
+        std::uint32_t& cursor = cursors[k];
+
+        while (cursor < offsets[k + 1] && parsed[byKey[cursor]].popped) {
+                ++cursor;
+        }
+
+        return cursor < offsets[k + 1] ? parsed.begin() + byKey[cursor]
+                : parsed.end();
+}
+
+void OptionParser::buildKeyIndex()
+{
+        // The keys are gathered once, the options are large and would be
+        // read twice otherwise
+        std::vector<unsigned char> keys(parsed.size());
+        offsets.fill(0);
+
+        for (std::size_t i = 0; i < parsed.size(); ++i) {
+                keys[i] = static_cast<unsigned char>(parsed[i].key);
+                ++offsets[keys[i] + 1];
+        }
+
+        for (std::size_t k = 1; k < offsets.size(); ++k) {
+                offsets[k] += offsets[k - 1];
+        }
+
+        std::copy(offsets.begin(), offsets.end() - 1, cursors.begin());
+        byKey.resize(parsed.size());
+
+        for (std::size_t i = 0; i < keys.size(); ++i) {
+                byKey[cursors[keys[i]]++] = static_cast<std::uint32_t>(i);
+        }
+
+        std::copy(offsets.begin(), offsets.end() - 1, cursors.begin());
+        buildNameIndex();
+}
+
+void OptionParser::buildNameIndex()
+{
+        // Without long options no parsed option has a name
+        bool named = std::any_of(options.begin(), options.end(),
+                        [](const Option& option) { return !option.name.empty(); });
+
+        // The option of every parsed option with a name, -1 for the others
+        std::vector<int> slots(named ? parsed.size() : 0, -1);
+
+        nameOffsets.assign(options.size() + 1, 0);
+
+        for (std::size_t i = 0; i < slots.size() && indexed; ++i) {
+                const std::string& name = parsed[i].name;
+
+                slots[i] = name.empty() ? -1
+                        : nameIndex.find(name.data(), name.size(), false);
+
+                if (slots[i] >= 0) {
+                        ++nameOffsets[slots[i] + 1];
+                }
+        }
+
+        for (std::size_t k = 1; k < nameOffsets.size(); ++k) {
+                nameOffsets[k] += nameOffsets[k - 1];
+        }
+
+        nameCursors.assign(nameOffsets.begin(), nameOffsets.end() - 1);
+        byName.resize(nameOffsets.back());
+
+        for (std::size_t i = 0; i < slots.size(); ++i) {
+                if (slots[i] >= 0) {
+                        byName[nameCursors[slots[i]]++] = static_cast<std::uint32_t>(i);
+                }
+        }
+
+        nameCursors.assign(nameOffsets.begin(), nameOffsets.end() - 1);
+        namesIndexed = true;
+}
+
+std::vector<OptionParser::Option>::iterator OptionParser::next(
+                const std::string& name)
+{
+        // Options added since the last freeze have no slot yet
+        if (!indexed) {
+                return std::find_if(parsed.begin(), parsed.end(),
+                                [&name](const Option& option) {
+                                        return !option.name.empty()
+                                                && option.name == name
+                                                && !option.popped;
+                                });
+        }
+
+        if (!namesIndexed) {
+                buildNameIndex();
+        }
+
+        int slot = name.empty() ? -1
+                : nameIndex.find(name.data(), name.size(), false);
+
+        if (slot < 0) {
+                return parsed.end();
+        }
+
+        std::uint32_t& cursor = nameCursors[slot];
+
+        while (cursor < nameOffsets[slot + 1] && parsed[byName[cursor]].popped) {
+                ++cursor;
+        }
+
+        return cursor < nameOffsets[slot + 1] ? parsed.begin() + byName[cursor]
+                : parsed.end();
+}
+
+const std::vector<int>& OptionParser::scope(const char& key)
+{
+        const std::vector<int>* existing = findScope(key);
+
+        if (existing) {
+                return *existing;
+        }
+
+        int count = 1;
+        for (const Option& option : parsed) {
+                count = std::max(count, option.index + 1);
+        }
+
+        std::vector<int> last(count, -1);
+
+        for (std::size_t i = 0; i < parsed.size(); ++i) {
+                if (parsed[i].key == key) {
+                        last[parsed[i].index] = static_cast<int>(i);
+                }
+        }
+
+        for (int i = 1; i < count; ++i) {
+                last[i] = last[i] < 0 ? last[i - 1] : last[i];
+        }
+
+        scopes.push_back({ key, std::move(last) });
+        return scopes.back().second;
+}
+
+const std::vector<int>* OptionParser::findScope(const char& key) const
+{
+        auto it = std::find_if(scopes.begin(), scopes.end(),
+                        [key](const std::pair<char, std::vector<int>>& scope) {
+                                return scope.first == key;
+                        });
+
+        return it == scopes.end() ? nullptr : &(*it).second;
+}
+
+const std::string& OptionParser::scopedValue(const std::vector<int>& last,
+                int index) const
+{
+        static const std::string empty;
+
+        if (index < 0 || last.empty()) {
+                return empty;
+        }
+
+        int i = last[std::min<std::size_t>(index, last.size() - 1)];
+        return i < 0 ? empty : parsed[i].value;
+}
+
+bool OptionParser::popSize(const char& key, std::uint64_t& bytes)
+{
+        auto it = next(key);
+
+        if (it == parsed.end()) {
+                return false;
+        }
+
+        const std::string& value = (*it).value;
+        bool valid = parseScaled(value.data(), value.data() + value.size(),
+                        sizeUnits, bytes);
+        (*it).popped = true;
+
+        return valid;
+}
+
+bool OptionParser::popDuration(const char& key,
+                std::chrono::nanoseconds& duration)
+{
+        auto it = next(key);
+
+        if (it == parsed.end()) {
+                return false;
+        }
+
+        const std::string& value = (*it).value;
+        std::uint64_t ns;
+        bool valid = parseScaled(value.data(), value.data() + value.size(),
+                        durationUnits, ns)
+                && ns <= std::uint64_t(std::chrono::nanoseconds::max().count());
+        (*it).popped = true;
+
+        if (valid) {
+                duration = std::chrono::nanoseconds(ns);
+        }
+
+        return valid;
+}
+
+bool OptionParser::popRate(const char& key, std::uint64_t& count,
+                std::chrono::nanoseconds& period)
+{
+        auto it = next(key);
+
+        if (it == parsed.end()) {
+                return false;
+        }
+
+        const std::string& value = (*it).value;
+        const char* first = value.data();
+        const char* last = first + value.size();
+        const char* slash = static_cast<const char*>(
+                        std::memchr(first, '/', value.size()));
+
+        std::uint64_t number;
+        std::uint64_t ns = durationUnits[0].factor;
+        bool valid = parseScaled(first, slash ? slash : last, countUnits, number);
+
+        if (valid && slash) {
+                // A period without a number like '/ms' counts as one unit
+                if (slash + 1 < last && std::isdigit(
+                                static_cast<unsigned char>(slash[1]))) {
+                        valid = parseScaled(slash + 1, last, durationUnits, ns);
+                } else {
+                        valid = slash + 1 < last
+                                && scale(1, slash + 1, last, durationUnits, ns);
+                }
+        }
+
+        valid = valid && ns > 0
+                && ns <= std::uint64_t(std::chrono::nanoseconds::max().count());
+        (*it).popped = true;
 
-                if (option.expectsValue && token.size() <= 2) {
-                        std::cout << argv[0] << ": missing value after '-"
-                                << key << "'" << std::endl;
-                        return false;
+        if (valid) {
+                count = number;
+                period = std::chrono::nanoseconds(ns);
+        }
+
+        return valid;
+}
+
+bool OptionParser::fail(Error kind, int index, char key)
+{
+        if (errors < maxDiagnostics) {
+                diagnosticBuffer[errors] = { kind, index, key };
+        }
+
+        ++errors;
+        return !collect;
+}
+
+bool OptionParser::Pattern::matches(const char* first, const char* last) const
+{
+        std::uint8_t state = 1;
+
+        for (; first != last && state != 0; ++first) {
+                state = next[state][static_cast<unsigned char>(*first)];
+        }
+
+        return accepting[state];
+}
+
+const OptionParser::Option* OptionParser::suggest(const std::string& name) const
+{
+        if (name.empty() || name.size() > 64) {
+                return nullptr;
+        }
+
+        std::uint64_t peq[256] = {};
+        for (std::size_t i = 0; i < name.size(); ++i) {
+                peq[static_cast<unsigned char>(name[i])] |= 1ull << i;
+        }
+
+        // Short names would match almost anything with a distance of two
+        std::size_t best = name.size() <= 3 ? 1 : 2;
+        const Option* suggestion = nullptr;
+
+        for (const Option& option : options) {
+                std::size_t size = option.name.size();
+                std::size_t difference = size > name.size()
+                        ? size - name.size() : name.size() - size;
+
+                if (size == 0 || difference > best) {
+                        continue;
                 }
 
-                if (!option.expectsValue && token.size() > 2) {
-                        std::cout << argv[0] << ": option '-" << key
-                                << "' doesn't allow a value" << std::endl;
-                        return false;
+                std::size_t distance = editDistance(peq, name.size(), option.name);
+                if (distance < best || (distance == best && !suggestion)) {
+                        best = distance;
+                        suggestion = &option;
+                }
+        }
+
+        return suggestion;
+}
+
+std::size_t OptionParser::editDistance(const std::uint64_t (&peq)[256],
+                std::size_t size, const std::string& text)
+{
+        std::uint64_t pv = ~0ull;
+        std::uint64_t mv = 0;
+        std::uint64_t last = 1ull << (size - 1);
+        std::size_t distance = size;
+
+        for (char c : text) {
+                std::uint64_t eq = peq[static_cast<unsigned char>(c)];
+                std::uint64_t xv = eq | mv;
+                std::uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+                std::uint64_t ph = mv | ~(xh | pv);
+                std::uint64_t mh = pv & xh;
+
+                if (ph & last) {
+                        ++distance;
+                } else if (mh & last) {
+                        --distance;
+                }
+
+                ph = (ph << 1) | 1;
+                mh = mh << 1;
+                pv = mh | ~(xv | ph);
+                mv = ph & xv;
+        }
+
+        return distance;
+}
+
+void OptionParser::NameIndex::build(
+                std::vector<std::pair<std::string, int>> names)
+{
+        std::stable_sort(names.begin(), names.end(),
+                        [](const std::pair<std::string, int>& a,
+                                const std::pair<std::string, int>& b) {
+                                return a.first < b.first;
+                        });
+        names.erase(std::unique(names.begin(), names.end(),
+                        [](const std::pair<std::string, int>& a,
+                                const std::pair<std::string, int>& b) {
+                                return a.first == b.first;
+                        }), names.end());
+
+        nodes.clear();
+        edges.clear();
+        build(names, 0, names.size(), 0);
+}
+
+std::uint32_t OptionParser::NameIndex::build(
+                const std::vector<std::pair<std::string, int>>& names,
+                std::size_t first, std::size_t last, std::size_t depth)
+{
+        std::uint32_t node = static_cast<std::uint32_t>(nodes.size());
+        nodes.push_back({ 0, 0, -1, last - first == 1 ? names[first].second : -2 });
+
+        // The names are sorted, so a name ending here comes first
+        if (first < last && names[first].first.size() == depth) {
+                nodes[node].value = names[first].second;
+                ++first;
+        }
+
+        std::uint32_t count = 0;
+        for (std::size_t i = first; i < last; ++i) {
+                if (i == first || names[i].first[depth] != names[i - 1].first[depth]) {
+                        ++count;
+                }
+        }
+
+        std::uint32_t firstEdge = static_cast<std::uint32_t>(edges.size());
+        nodes[node].firstEdge = firstEdge;
+        nodes[node].edgeCount = count;
+        edges.resize(edges.size() + count);
+
+        for (std::uint32_t edge = firstEdge; first < last; ++edge) {
+                char label = names[first].first[depth];
+                std::size_t end = first;
+
+                while (end < last && names[end].first[depth] == label) {
+                        ++end;
+                }
+
+                std::uint32_t child = build(names, first, end, depth + 1);
+                edges[edge] = { label, child };
+                first = end;
+        }
+
+        return node;
+}
+
+int OptionParser::NameIndex::find(const char* name, std::size_t size,
+                bool allowPrefix) const
+{
+        if (size == 0 || nodes.empty()) {
+                return -1;
+        }
+
+        std::uint32_t node = 0;
+
+        for (std::size_t i = 0; i < size; ++i) {
+                const Node& current = nodes[node];
+                const Edge* edge = edges.data() + current.firstEdge;
+                const Edge* end = edge + current.edgeCount;
+
+                while (edge < end && edge->label != name[i]) {
+                        ++edge;
+                }
+
+                if (edge == end) {
+                        return -1;
+                }
+
+                node = edge->child;
+        }
+
+        if (nodes[node].value >= 0 || !allowPrefix) {
+                return nodes[node].value;
+        }
+
+        return nodes[node].unique;
+}
+
+void OptionParser::publish(const std::vector<Option>& changes)
+{
+        // Only writers free snapshots and they hold 'parsing'
+        const Snapshot* current = shared->live.load();
+        std::unique_ptr<Snapshot> next(current ? new Snapshot(*current)
+                        : new Snapshot());
+
+        // Snapshots hold the latest value of each live option
+        for (const Option& option : changes) {
+                if (!option.live) {
+                        continue;
                 }
 
-                if (option.expectsValue && token.size() > 2) {
-                        option.value = token.substr(2);
+                auto it = std::find_if(next->options.begin(), next->options.end(),
+                                Compare(option.key));
+
+                if (it == next->options.end()) {
+                        next->options.push_back(option);
+                } else {
+                        *it = option;
                 }
+        }
+
+        shared->replace(shared->live, next.release());
+}
+
+bool OptionParser::Shared::reload()
+{
+        std::ifstream file(configPath);
+        std::stringstream text;
+        std::lock_guard<std::mutex> lock(parsing);
+
+        if (!file || !(text << file.rdbuf())) {
+                std::cout << schema->program << ": can't read '" << configPath
+                        << "'" << std::endl;
+                return false;
+        }
+
+        std::vector<std::string> args = split(text.str());
+        std::unique_ptr<Snapshot> next(new Snapshot());
 
-                parsed.push_back(option);
+        if (!schema->parseTokens(args, next->options)) {
+                return false;
         }
 
-        options.clear();
+        replace(config, next.release());
         return true;
 }
 
-void OptionParser::add(const char& key, bool expectsValue = false)
+void OptionParser::Shared::watchLoop()
 {
-        options.push_back({ key, "", expectsValue });
+#if defined(__linux__)
+        std::string::size_type slash = configPath.rfind('/');
+        std::string name = slash == std::string::npos
+                ? configPath : configPath.substr(slash + 1);
+
+        alignas(inotify_event) char buffer[4096];
+        pollfd fds[] = { { watchFd, POLLIN, 0 }, { stopFd, POLLIN, 0 } };
+
+        while (!(fds[1].revents & POLLIN)) {
+                // A signal handled by this thread mustn't stop the reloads
+                if (poll(fds, 2, -1) < 0) {
+                        if (errno == EINTR) {
+                                continue;
+                        }
+                        break;
+                }
+
+                if (fds[0].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+                        break;
+                }
+
+                if (fds[1].revents & POLLIN || !(fds[0].revents & POLLIN)) {
+                        continue;
+                }
+
+                ssize_t size = read(watchFd, buffer, sizeof(buffer));
+                bool changed = false;
+
+                if (size < 0) {
+                        if (errno == EINTR || errno == EAGAIN) {
+                                continue;
+                        }
+                        break;
+                }
+
+                for (ssize_t i = 0; i < size; ) {
+                        const inotify_event* event
+                                = reinterpret_cast<const inotify_event*>(buffer + i);
+                        changed = changed || (event->len > 0 && name == event->name);
+                        i += sizeof(inotify_event) + event->len;
+                }
+
+                if (changed) {
+                        reload();
+                }
+        }
+#endif
+        watching = false;
 }
 
-bool OptionParser::has(const char& key)
+std::vector<std::string> OptionParser::split(const std::string& text)
 {
-        auto it = std::find_if(parsed.begin(), parsed.end(),
-                        Compare(key));
+        const char* whitespace = " \t\r\n";
+        std::vector<std::string> tokens;
+        std::string::size_type first = text.find_first_not_of(whitespace);
 
-        return it != parsed.end();
+        while (first != std::string::npos) {
+                std::string::size_type last = text.find_first_of(whitespace, first);
+
+                if (text[first] == '#') {
+                        last = text.find('\n', first);
+                } else {
+                        tokens.push_back(text.substr(first, last - first));
+                }
+
+                first = text.find_first_not_of(whitespace, last);
+        }
+
+        return tokens;
 }
 
-std::string OptionParser::popValue(const char& key)
+bool OptionParser::freeze()
 {
-        auto it = std::find_if(parsed.begin(), parsed.end(),
-                        Compare(key));
+        // The bytes of code point keys are given out again below
+        for (Option& option : options) {
+                if (option.codePoint != 0) {
+                        option.key = '\0';
+                }
+        }
 
-        std::string value = it == parsed.end() ? "" : (*it).value;
-        parsed.erase(it);
+        // Sorting puts options with the same key or name next to each other
+        std::sort(options.begin(), options.end(),
+                        [](const Option& a, const Option& b) {
+                                unsigned char x = a.key;
+                                unsigned char y = b.key;
 
-        return value;
+                                return x < y || (x == y && (a.codePoint < b.codePoint
+                                                || (a.codePoint == b.codePoint
+                                                        && a.name < b.name)));
+                        });
+
+        for (std::size_t i = 1; i < options.size(); ++i) {
+                const Option& a = options[i - 1];
+                const Option& b = options[i];
+
+                if (b.key != '\0' && a.key == b.key) {
+                        return duplicate(std::string("-") + b.key, b.key);
+                }
+
+                if (b.codePoint != 0 && a.codePoint == b.codePoint) {
+                        char text[4];
+                        return duplicate("-" + std::string(text,
+                                                encode(b.codePoint, text)), '\0');
+                }
+        }
+
+        std::vector<const std::string*> names;
+
+        for (const Option& option : options) {
+                if (!option.name.empty()) {
+                        names.push_back(&option.name);
+                }
+        }
+
+        auto less = [](const std::string* a, const std::string* b) {
+                return *a < *b;
+        };
+        auto equal = [](const std::string* a, const std::string* b) {
+                return *a == *b;
+        };
+
+        std::sort(names.begin(), names.end(), less);
+        auto it = std::adjacent_find(names.begin(), names.end(), equal);
+
+        if (it != names.end()) {
+                return duplicate("--" + **it, '\0');
+        }
+
+        for (std::size_t i = 0; i < families.size(); ++i) {
+                const Family& family = families[i];
+
+                for (std::size_t j = 0; j < i; ++j) {
+                        if (families[j].prefix == family.prefix) {
+                                return duplicate(std::string("-") + family.prefix,
+                                                family.prefix);
+                        }
+                }
+
+                if (std::any_of(options.begin(), options.end(),
+                                        Compare(family.prefix))) {
+                        return duplicate(std::string("-") + family.prefix,
+                                                family.prefix);
+                }
+
+                names.clear();
+                for (const auto& member : family.members) {
+                        names.push_back(&member.name);
+                }
+
+                std::sort(names.begin(), names.end(), less);
+                it = std::adjacent_find(names.begin(), names.end(), equal);
+
+                if (it != names.end()) {
+                        return duplicate(std::string("-") + family.prefix + **it,
+                                        family.prefix);
+                }
+        }
+
+        if (!assignKeys()) {
+                out() << (program.empty() ? "picoarg" : program)
+                        << ": too many option keys" << std::endl;
+                fail(Error::TooManyKeys, 0, '\0');
+
+                return false;
+        }
+
+        buildIndex();
+        namesIndexed = false;
+        return true;
+}
+
+bool OptionParser::assignKeys()
+{
+        std::array<bool, 256> used {};
+
+        for (const Option& option : options) {
+                used[static_cast<unsigned char>(option.key)] = true;
+        }
+
+        for (const Family& family : families) {
+                used[static_cast<unsigned char>(family.prefix)] = true;
+        }
+
+        int next = 255;
+
+        for (Option& option : options) {
+                if (option.codePoint == 0) {
+                        continue;
+                }
+
+                while (next >= 0x80 && used[next]) {
+                        --next;
+                }
+
+                if (next < 0x80) {
+                        return false;
+                }
+
+                option.key = static_cast<char>(next);
+                used[next] = true;
+        }
+
+        return true;
+}
+
+int OptionParser::findCodePoint(char32_t codePoint) const
+{
+        std::size_t page = codePoint >> 8;
+
+        if (page >= codePointPages.size() || codePointPages[page] == 0) {
+                return -1;
+        }
+
+        return codePointBlocks[codePointPages[page] - 1][codePoint & 255];
+}
+
+char OptionParser::keyOf(char32_t codePoint) const
+{
+        if (codePoint < 0x80) {
+                return static_cast<char>(codePoint);
+        }
+
+        int slot = findCodePoint(codePoint);
+
+        return slot < 0 ? '\0' : options[slot].key;
+}
+
+char32_t OptionParser::decode(const char* text, std::size_t& length)
+{
+        // Indexed by the top 5 bits of the first byte
+        static constexpr std::uint8_t lengths[32] = {
+                1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+                0, 0, 0, 0, 0, 0, 0, 0, 2, 2, 2, 2, 3, 3, 4, 0
+        };
+        static constexpr std::uint8_t masks[5] = { 0, 0x7f, 0x1f, 0x0f, 0x07 };
+        static constexpr std::uint8_t shifts[5] = { 0, 18, 12, 6, 0 };
+        static constexpr std::uint8_t continuations[5] = { 0, 0, 1, 3, 7 };
+        static constexpr char32_t minimums[5] = { 0, 0, 0x80, 0x800, 0x10000 };
+
+        // A NUL byte stops the loads, it fails the continuation check below
+        std::uint8_t b[4] = { static_cast<std::uint8_t>(text[0]) };
+        b[1] = b[0] ? static_cast<std::uint8_t>(text[1]) : 0;
+        b[2] = b[1] ? static_cast<std::uint8_t>(text[2]) : 0;
+        b[3] = b[2] ? static_cast<std::uint8_t>(text[3]) : 0;
+
+        std::size_t n = lengths[b[0] >> 3];
+        char32_t codePoint = ((char32_t(b[0] & masks[n]) << 18)
+                        | (char32_t(b[1] & 0x3f) << 12)
+                        | (char32_t(b[2] & 0x3f) << 6)
+                        | char32_t(b[3] & 0x3f)) >> shifts[n];
+
+        unsigned found = ((b[1] & 0xc0) == 0x80)
+                | (((b[2] & 0xc0) == 0x80) << 1)
+                | (((b[3] & 0xc0) == 0x80) << 2);
+
+        bool valid = n != 0
+                && (found & continuations[n]) == continuations[n]
+                && codePoint >= minimums[n]
+                && codePoint <= 0x10ffff
+                && (codePoint >> 11) != 0x1b;
+
+        length = valid ? n : 0;
+        return codePoint;
+}
+
+std::size_t OptionParser::encode(char32_t codePoint, char (&text)[4])
+{
+        if (codePoint < 0x80) {
+                text[0] = static_cast<char>(codePoint);
+                return 1;
+        }
+
+        if (codePoint < 0x800) {
+                text[0] = static_cast<char>(0xc0 | (codePoint >> 6));
+                text[1] = static_cast<char>(0x80 | (codePoint & 0x3f));
+                return 2;
+        }
+
+        if (codePoint < 0x10000) {
+                text[0] = static_cast<char>(0xe0 | (codePoint >> 12));
+                text[1] = static_cast<char>(0x80 | ((codePoint >> 6) & 0x3f));
+                text[2] = static_cast<char>(0x80 | (codePoint & 0x3f));
+                return 3;
+        }
+
+        text[0] = static_cast<char>(0xf0 | (codePoint >> 18));
+        text[1] = static_cast<char>(0x80 | ((codePoint >> 12) & 0x3f));
+        text[2] = static_cast<char>(0x80 | ((codePoint >> 6) & 0x3f));
+        text[3] = static_cast<char>(0x80 | (codePoint & 0x3f));
+        return 4;
+}
+
+bool OptionParser::duplicate(const std::string& flag, const char& key)
+{
+        out() << (program.empty() ? "picoarg" : program)
+                << ": duplicate option '" << flag << "'" << std::endl;
+        fail(Error::DuplicateOption, 0, key);
+
+        return false;
+}
+
+void OptionParser::buildIndex()
+{
+        std::vector<std::pair<std::string, int>> names;
+
+        keySlots.fill(-1);
+
+        for (std::size_t i = 0; i < options.size(); ++i) {
+                if (options[i].key != '\0') {
+                        keySlots[static_cast<unsigned char>(options[i].key)] = int(i);
+                }
+        }
+
+        for (std::size_t i = 0; i < families.size(); ++i) {
+                keySlots[static_cast<unsigned char>(families[i].prefix)] = -2 - int(i);
+        }
+
+        codePointPages.clear();
+        codePointBlocks.clear();
+
+        for (std::size_t i = 0; i < options.size(); ++i) {
+                char32_t codePoint = options[i].codePoint;
+
+                if (codePoint == 0) {
+                        continue;
+                }
+
+                // The byte 'assignKeys' gave the option isn't a key in argv
+                keySlots[static_cast<unsigned char>(options[i].key)] = -1;
+
+                std::size_t page = codePoint >> 8;
+                if (page >= codePointPages.size()) {
+                        codePointPages.resize(page + 1, 0);
+                }
+
+                if (codePointPages[page] == 0) {
+                        codePointBlocks.emplace_back();
+                        codePointBlocks.back().fill(-1);
+                        codePointPages[page] = static_cast<std::uint16_t>(
+                                        codePointBlocks.size());
+                }
+
+                codePointBlocks[codePointPages[page] - 1][codePoint & 255] = int(i);
+        }
+
+        for (std::size_t i = 0; i < options.size(); ++i) {
+                if (!options[i].name.empty()) {
+                        names.push_back({ options[i].name, int(i) });
+                }
+        }
+
+        nameIndex.build(std::move(names));
+
+        for (Family& family : families) {
+                names.clear();
+
+                for (std::size_t i = 0; i < family.members.size(); ++i) {
+                        names.push_back({ family.members[i].name, int(i) });
+                }
+
+                family.index.build(std::move(names));
+        }
+
+        indexed = true;
+}
+
+void OptionParser::addRegistered()
+{
+        if (registered) {
+                return;
+        }
+
+#if defined(__ELF__)
+        const Descriptor* first = __start_picoarg_options;
+        const Descriptor* last = __stop_picoarg_options;
+
+        for (const Descriptor* it = first; it && it < last; ++it) {
+                options.push_back({ (*it).key, "", (*it).expectsValue, -1, 0,
+                                (*it).name ? (*it).name : "" });
+        }
+
+        indexed = indexed && first == last;
+#endif
+        registered = true;
 }
 
-bool OptionParser::isOption(const std::string& token)
+bool OptionParser::isOption(const std::string& token) const
 {
         return (token.size() > 1 && token[0] == '-');
 }
 
+template <std::size_t N>
+bool OptionParser::parseScaled(const char* first, const char* last,
+                const Unit (&units)[N], std::uint64_t& value)
+{
+        std::uint64_t number;
+        auto result = std::from_chars(first, last, number);
+
+        if (result.ec != std::errc() || result.ptr == first) {
+                return false;
+        }
+
+        return scale(number, result.ptr, last, units, value);
+}
+
+template <std::size_t N>
+bool OptionParser::scale(std::uint64_t number, const char* first,
+                const char* last, const Unit (&units)[N], std::uint64_t& value)
+{
+        std::size_t size = last - first;
+
+        for (const Unit& unit : units) {
+                if (std::strlen(unit.suffix) == size
+                                && std::memcmp(unit.suffix, first, size) == 0) {
+                        if (number > UINT64_MAX / unit.factor) {
+                                return false;
+                        }
+
+                        value = number * unit.factor;
+                        return true;
+                }
+        }
+
+        return false;
+}
+
 #endif // PICOARG_IMPL
 
 /*